@@ -0,0 +1,443 @@
+#include "store.h"
+
+#include "common.h"
+
+/* B+-tree of events. Branches count the events under each child, so
+ * positions are found in O(log n) like keys are, and the leaves are
+ * linked for scans in order. */
+
+#define LEAF_CAP   32 //events per leaf
+#define BRANCH_CAP 64 //children per branch
+
+//siblings are merged once they fit in this fraction of a node, leaving
+//room so that a merge is not undone by the next insert
+#define MERGE_NUM 3
+#define MERGE_DEN 4
+
+typedef struct Node {
+    bool leaf;
+    unsigned n; //events of a leaf or children of a branch
+} Node;
+
+/* Arrays have room for one more than the capacity, which is split off
+ * after inserting */
+typedef struct Leaf {
+    Node node;
+    struct Leaf *prev;
+    struct Leaf *next;
+    uint64_t keys[LEAF_CAP + 1]; //sort keys, searched without touching events
+    Event events[LEAF_CAP + 1];
+} Leaf;
+
+typedef struct Branch {
+    Node node;
+    uint64_t keys[BRANCH_CAP + 1]; //keys[k] bounds child k from below, k > 0
+    size_t counts[BRANCH_CAP + 1]; //events under each child
+    Node *children[BRANCH_CAP + 1];
+} Branch;
+
+struct EventStore {
+    Node *root; //NULL when empty
+    Leaf *first;
+    size_t count;
+};
+
+static Leaf *new_leaf(void)
+{
+    Leaf *l = malloc(sizeof(*l));
+    if (!l)
+        FATAL("Failed to allocate tree node!");
+    l->node = (Node){true, 0};
+    l->prev = l->next = NULL;
+    return l;
+}
+
+static Branch *new_branch(void)
+{
+    Branch *b = malloc(sizeof(*b));
+    if (!b)
+        FATAL("Failed to allocate tree node!");
+    b->node = (Node){false, 0};
+    return b;
+}
+
+static void free_node(Node *n)
+{
+    if (!n->leaf) {
+        Branch *b = (Branch *)n;
+        for (unsigned k = 0; k < b->node.n; k++)
+            free_node(b->children[k]);
+    }
+    free(n);
+}
+
+static size_t node_count(const Node *n)
+{
+    if (n->leaf)
+        return n->n;
+    const Branch *b = (const Branch *)n;
+    size_t count = 0;
+    for (unsigned k = 0; k < b->node.n; k++)
+        count += b->counts[k];
+    return count;
+}
+
+/* Child of b whose subtree holds the first event not less than key, or
+ * is followed by it */
+static unsigned branch_child(const Branch *b, uint64_t key)
+{
+    unsigned lo = 1, hi = b->node.n;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (b->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+static unsigned leaf_pos(const Leaf *l, uint64_t key)
+{
+    unsigned lo = 0, hi = l->node.n;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (l->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Child of b holding position *i, which is made relative to the child */
+static unsigned rank_child(const Branch *b, size_t *i)
+{
+    unsigned k = 0;
+    while (*i >= b->counts[k])
+        *i -= b->counts[k++];
+    return k;
+}
+
+/* Leaf holding position *i < count, which is made relative to the leaf */
+static Leaf *find_rank(const EventStore *s, size_t *i)
+{
+    Node *n = s->root;
+    while (!n->leaf) {
+        Branch *b = (Branch *)n;
+        n = b->children[rank_child(b, i)];
+    }
+    return (Leaf *)n;
+}
+
+EventStore *store_new(void)
+{
+    EventStore *s = calloc(1, sizeof(*s));
+    if (!s)
+        FATAL("Failed to allocate event store!");
+    return s;
+}
+
+/* Frees the store but not the strings of its events */
+void store_free(EventStore *s)
+{
+    if (s->root)
+        free_node(s->root);
+    free(s);
+}
+
+size_t store_count(const EventStore *s)
+{
+    return s->count;
+}
+
+/* Returns the position of the first event whose sort key is not less
+ * than key */
+size_t store_lower_bound(const EventStore *s, uint64_t key)
+{
+    if (!s->root)
+        return 0;
+
+    size_t rank = 0;
+    const Node *n = s->root;
+    while (!n->leaf) {
+        const Branch *b = (const Branch *)n;
+        unsigned k = branch_child(b, key);
+        for (unsigned j = 0; j < k; j++)
+            rank += b->counts[j];
+        n = b->children[k];
+    }
+    return rank + leaf_pos((const Leaf *)n, key);
+}
+
+Event *store_at(EventStore *s, size_t i)
+{
+    if (i >= s->count)
+        return NULL;
+    Leaf *l = find_rank(s, &i);
+    return &l->events[i];
+}
+
+/* Moves the upper half of a full leaf to a new leaf after it */
+static Leaf *split_leaf(Leaf *l)
+{
+    Leaf *r = new_leaf();
+    unsigned half = l->node.n / 2;
+    r->node.n = l->node.n - half;
+    memcpy(r->keys, l->keys + half, r->node.n * sizeof(r->keys[0]));
+    memcpy(r->events, l->events + half, r->node.n * sizeof(r->events[0]));
+    l->node.n = half;
+
+    r->prev = l;
+    r->next = l->next;
+    if (l->next)
+        l->next->prev = r;
+    l->next = r;
+    return r;
+}
+
+static Branch *split_branch(Branch *b)
+{
+    Branch *r = new_branch();
+    unsigned half = b->node.n / 2;
+    r->node.n = b->node.n - half;
+    memcpy(r->keys, b->keys + half, r->node.n * sizeof(r->keys[0]));
+    memcpy(r->counts, b->counts + half, r->node.n * sizeof(r->counts[0]));
+    memcpy(r->children, b->children + half, r->node.n * sizeof(r->children[0]));
+    b->node.n = half;
+    return r;
+}
+
+/* Inserts e before the events of the subtree at n with the same key. If
+ * n overflows, its upper half is split off and returned, with the key
+ * bounding it from below stored in *sep. */
+static Node *insert(Node *n, uint64_t key, Event e, uint64_t *sep)
+{
+    if (n->leaf) {
+        Leaf *l = (Leaf *)n;
+        unsigned pos = leaf_pos(l, key);
+        memmove(l->keys + pos + 1, l->keys + pos, (l->node.n - pos) * sizeof(l->keys[0]));
+        memmove(l->events + pos + 1, l->events + pos, (l->node.n - pos) * sizeof(l->events[0]));
+        l->keys[pos] = key;
+        l->events[pos] = e;
+        if (++l->node.n <= LEAF_CAP)
+            return NULL;
+
+        Leaf *r = split_leaf(l);
+        *sep = r->keys[0];
+        return &r->node;
+    }
+
+    Branch *b = (Branch *)n;
+    unsigned k = branch_child(b, key);
+    b->counts[k]++;
+    uint64_t child_sep;
+    Node *split = insert(b->children[k], key, e, &child_sep);
+    if (!split)
+        return NULL;
+
+    unsigned move = b->node.n - k - 1;
+    memmove(b->keys + k + 2, b->keys + k + 1, move * sizeof(b->keys[0]));
+    memmove(b->counts + k + 2, b->counts + k + 1, move * sizeof(b->counts[0]));
+    memmove(b->children + k + 2, b->children + k + 1, move * sizeof(b->children[0]));
+    b->keys[k + 1] = child_sep;
+    b->counts[k + 1] = node_count(split);
+    b->counts[k] -= b->counts[k + 1];
+    b->children[k + 1] = split;
+    if (++b->node.n <= BRANCH_CAP)
+        return NULL;
+
+    Branch *r = split_branch(b);
+    *sep = r->keys[0];
+    return &r->node;
+}
+
+void store_insert(EventStore *s, Event e)
+{
+    uint64_t key = event_sort_key(e);
+    if (!s->root) {
+        s->first = new_leaf();
+        s->root = &s->first->node;
+    }
+
+    uint64_t sep;
+    Node *split = insert(s->root, key, e, &sep);
+    if (split) {
+        Branch *root = new_branch();
+        root->node.n = 2;
+        root->children[0] = s->root;
+        root->children[1] = split;
+        root->keys[1] = sep;
+        root->counts[1] = node_count(split);
+        root->counts[0] = s->count + 1 - root->counts[1];
+        s->root = &root->node;
+    }
+    s->count++;
+}
+
+/* Merges child k + 1 of b into child k */
+static void merge_children(Branch *b, unsigned k)
+{
+    Node *left = b->children[k];
+    Node *right = b->children[k + 1];
+
+    if (left->leaf) {
+        Leaf *l = (Leaf *)left, *r = (Leaf *)right;
+        memcpy(l->keys + l->node.n, r->keys, r->node.n * sizeof(r->keys[0]));
+        memcpy(l->events + l->node.n, r->events, r->node.n * sizeof(r->events[0]));
+        l->next = r->next;
+        if (r->next)
+            r->next->prev = l;
+    } else {
+        Branch *l = (Branch *)left, *r = (Branch *)right;
+        //the first child of r is bounded by the key separating l and r
+        r->keys[0] = b->keys[k + 1];
+        memcpy(l->keys + l->node.n, r->keys, r->node.n * sizeof(r->keys[0]));
+        memcpy(l->counts + l->node.n, r->counts, r->node.n * sizeof(r->counts[0]));
+        memcpy(l->children + l->node.n, r->children, r->node.n * sizeof(r->children[0]));
+    }
+    left->n += right->n;
+    free(right);
+
+    b->counts[k] += b->counts[k + 1];
+    unsigned move = b->node.n - k - 2;
+    memmove(b->keys + k + 1, b->keys + k + 2, move * sizeof(b->keys[0]));
+    memmove(b->counts + k + 1, b->counts + k + 2, move * sizeof(b->counts[0]));
+    memmove(b->children + k + 1, b->children + k + 2, move * sizeof(b->children[0]));
+    b->node.n--;
+}
+
+/* Merges child k of b with a sibling if it emptied or they fit in one
+ * node with room to spare */
+static void rebalance(Branch *b, unsigned k)
+{
+    if (b->node.n < 2)
+        return;
+    unsigned left = k ? k - 1 : k;
+    Node *l = b->children[left], *r = b->children[left + 1];
+    unsigned cap = l->leaf ? LEAF_CAP : BRANCH_CAP;
+    unsigned n = l->n + r->n;
+    if (!b->children[k]->n || n * MERGE_DEN <= cap * MERGE_NUM)
+        merge_children(b, left);
+}
+
+static void remove_at(Node *n, size_t i)
+{
+    if (n->leaf) {
+        Leaf *l = (Leaf *)n;
+        l->node.n--;
+        memmove(l->keys + i, l->keys + i + 1, (l->node.n - i) * sizeof(l->keys[0]));
+        memmove(l->events + i, l->events + i + 1, (l->node.n - i) * sizeof(l->events[0]));
+        return;
+    }
+
+    Branch *b = (Branch *)n;
+    unsigned k = rank_child(b, &i);
+    b->counts[k]--;
+    remove_at(b->children[k], i);
+    rebalance(b, k);
+}
+
+/* Removes the event at position i, without destroying it */
+void store_remove(EventStore *s, size_t i)
+{
+    if (i >= s->count)
+        return;
+    remove_at(s->root, i);
+    s->count--;
+
+    //drop roots left with a single child, or none
+    while (!s->root->leaf && s->root->n == 1) {
+        Branch *b = (Branch *)s->root;
+        s->root = b->children[0];
+        free(b);
+    }
+    if (!s->count) {
+        free_node(s->root);
+        s->root = NULL;
+        s->first = NULL;
+    }
+}
+
+/* Replaces the events of the store with n sorted events, filling the
+ * leaves and building the branches above them level by level. The array
+ * is freed, and the events replaced are not destroyed. */
+void store_assign(EventStore *s, Event *events, size_t n)
+{
+    if (s->root)
+        free_node(s->root);
+    s->root = NULL;
+    s->first = NULL;
+    s->count = n;
+    if (!n) {
+        free(events);
+        return;
+    }
+
+    size_t nnodes = (n + LEAF_CAP - 1) / LEAF_CAP;
+    Node **level = malloc(nnodes * sizeof(level[0]));
+    uint64_t *mins = malloc(nnodes * sizeof(mins[0]));
+    if (!level || !mins)
+        FATAL("Failed to allocate tree nodes!");
+
+    Leaf *prev = NULL;
+    for (size_t j = 0; j < nnodes; j++) {
+        Leaf *l = new_leaf();
+        l->node.n = MIN(LEAF_CAP, n - j * LEAF_CAP);
+        memcpy(l->events, events + j * LEAF_CAP, l->node.n * sizeof(l->events[0]));
+        for (unsigned i = 0; i < l->node.n; i++)
+            l->keys[i] = event_sort_key(l->events[i]);
+        l->prev = prev;
+        if (prev)
+            prev->next = l;
+        else
+            s->first = l;
+        prev = l;
+        level[j] = &l->node;
+        mins[j] = l->keys[0];
+    }
+    free(events);
+
+    while (nnodes > 1) {
+        size_t nparents = (nnodes + BRANCH_CAP - 1) / BRANCH_CAP;
+        for (size_t j = 0; j < nparents; j++) {
+            Branch *b = new_branch();
+            b->node.n = MIN(BRANCH_CAP, nnodes - j * BRANCH_CAP);
+            for (unsigned k = 0; k < b->node.n; k++) {
+                size_t c = j * BRANCH_CAP + k;
+                b->children[k] = level[c];
+                b->counts[k] = node_count(level[c]);
+                b->keys[k] = mins[c];
+            }
+            mins[j] = b->keys[0];
+            level[j] = &b->node;
+        }
+        nnodes = nparents;
+    }
+    s->root = level[0];
+    free(level);
+    free(mins);
+}
+
+StoreIter store_iter(EventStore *s, size_t i)
+{
+    if (i >= s->count)
+        return (StoreIter){NULL, 0};
+    if (!i)
+        return (StoreIter){s->first, 0};
+    Leaf *l = find_rank(s, &i);
+    return (StoreIter){l, i};
+}
+
+/* Returns the event at the iterator and moves past it, or NULL at the
+ * end */
+Event *store_next(StoreIter *it)
+{
+    Leaf *l = it->node;
+    while (l && it->pos >= l->node.n) {
+        l = l->next;
+        it->pos = 0;
+    }
+    it->node = l;
+    return l ? &l->events[it->pos++] : NULL;
+}
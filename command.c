@@ -0,0 +1,52 @@
+#include "command.h"
+
+#include "common.h"
+
+/* Registered commands, sorted by name */
+static Command *commands;
+static size_t ncommands;
+
+/* Index of the first command not sorting before name */
+static size_t find_index(const char *name)
+{
+    size_t lo = 0, hi = ncommands;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(commands[mid].name, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Adds a command, replacing any registered under the same name. name
+ * must outlive the table. */
+void command_register(const char *name, command_fn run)
+{
+    size_t i = find_index(name);
+    if (i < ncommands && !strcmp(commands[i].name, name)) {
+        commands[i].run = run;
+        return;
+    }
+    Command c = {name, run};
+    commands = add_element(commands, &ncommands, sizeof(c), i, &c);
+    if (!commands)
+        FATAL("Failed to allocate command table!");
+}
+
+const Command *command_find(const char *name)
+{
+    size_t i = find_index(name);
+    return i < ncommands && !strcmp(commands[i].name, name) ? &commands[i] : NULL;
+}
+
+size_t command_count(void)
+{
+    return ncommands;
+}
+
+const Command *command_get(size_t i)
+{
+    return i < ncommands ? &commands[i] : NULL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "database.h"
+
+/* State of an interactive session shared by command handlers */
+typedef struct Session {
+    Database *db;
+    char **filepath;
+    bool done; //set to end the session
+} Session;
+
+/* Runs a command given the rest of its line. Returns -1 on error, having
+ * reported it. */
+typedef int (*command_fn)(Session *s, char *args);
+
+typedef struct Command {
+    const char *name;
+    command_fn run;
+} Command;
+
+void command_register(const char *name, command_fn run);
+const Command *command_find(const char *name);
+size_t command_count(void);
+const Command *command_get(size_t i);
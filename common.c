@@ -142,3 +142,38 @@ void remove_element(void *base, size_t *nmemb, size_t size, unsigned i)
             (char *)base + (i + 1) * size,
             (*nmemb - i) * size);
 }
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+
+static inline uint64_t rotl64(uint64_t x, unsigned r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* 64-bit hash of len bytes at data, in the style of xxHash64 */
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    uint64_t h = seed + PRIME64_3 + len;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h ^= rotl64(k * PRIME64_2, 31) * PRIME64_1;
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_3;
+    }
+    for (; len > 0; p++, len--) {
+        h ^= *p * PRIME64_3;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    //avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
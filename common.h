@@ -2,6 +2,7 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,4 +45,5 @@ char *rmqt(const char *str);
 char *addqt(const char *str);
 void *add_element(void *base, size_t *nmemb, size_t size, unsigned i, void *new_elem);
 void remove_element(void *base, size_t *nmemb, size_t size, unsigned i);
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
 
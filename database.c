@@ -4,27 +4,113 @@
 #include "csv.h"
 #include "event.h"
 
+/* Files start with a header row of the magic token followed by
+ * key=value fields. Files without one are read as version 1. */
+#define DB_MAGIC   "#todo"
+#define DB_VERSION 4
+
 void database_init(Database *db)
 {
     db->modified = false;
-    db->count = 0;
-    db->events = NULL;
+    db->events = store_new();
+    for (unsigned p = LOW; p <= URGENT; p++)
+        db->by_priority[p] = store_new();
+    for (unsigned p = LOW; p <= URGENT; p++)
+        db->series[p] = (SeriesHeap){NULL, 0, 0};
+    db->series_from = NULL_DATE;
+    db->series_stale = true;
+    db->nrecurring = 0;
+    db->recurring = NULL;
+    trie_init(&db->tags);
+    db->postings = calloc(TAGMASK_BITS, sizeof(db->postings[0]));
+    if (!db->postings)
+        FATAL("Failed to allocate posting lists!");
+    db->next_id = 1;
+    db->generation = 0;
+    idmap_init(&db->ids);
+    db->bulk = NULL;
+    db->nbulk = 0;
+    db->bulk_cap = 0;
+    idmap_init(&db->dirty);
+    db->revision = 0;
+    qcache_init(&db->cache);
+    daystats_init(&db->days);
+    itree_init(&db->busy);
+    db->pinned = 0;
+    db->retired = NULL;
+    db->nretired = 0;
+}
+
+static void destroy_retired(Database *db)
+{
+    for (size_t i = 0; i < db->nretired; i++)
+        event_destroy(&db->retired[i]);
+    free(db->retired);
+    db->retired = NULL;
+    db->nretired = 0;
 }
 
 void database_destroy(Database *db)
 {
-    for (unsigned i = 0; i < db->count; i++) {
-        event_destroy(&db->events[i]);
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));)
+        event_destroy(e);
+    store_free(db->events);
+    db->events = NULL;
+    for (unsigned p = LOW; p <= URGENT; p++) {
+        store_free(db->by_priority[p]);
+        db->by_priority[p] = NULL;
+        free(db->series[p].nodes);
+        db->series[p] = (SeriesHeap){NULL, 0, 0};
     }
-    db->count = 0;
-    free(db->events);
+    free(db->bulk);
+    db->bulk = NULL;
+    db->nrecurring = 0;
+    free(db->recurring);
+    trie_destroy(&db->tags);
+    for (unsigned i = 0; i < TAGMASK_BITS; i++)
+        idmap_destroy(&db->postings[i]);
+    free(db->postings);
+    db->postings = NULL;
+    idmap_destroy(&db->ids);
+    idmap_destroy(&db->dirty);
+    qcache_destroy(&db->cache);
+    daystats_destroy(&db->days);
+    itree_destroy(&db->busy);
+    destroy_retired(db);
 }
 
-static int read_event(Event *e, char *line)
+static bool read_header(DbReader *r, char *line)
+{
+    char *tok = csv_next_tok(&line);
+    if (!tok || strcmp(tok, DB_MAGIC)) {
+        free(tok);
+        return false;
+    }
+    free(tok);
+
+    while ((tok = csv_next_tok(&line))) {
+        sscanf(tok, "version=%u", &r->version);
+        sscanf(tok, "next_id=%" SCNu64, &r->next_id);
+        sscanf(tok, "generation=%" SCNu64, &r->generation);
+        free(tok);
+    }
+    return true;
+}
+
+static int read_event(Event *e, char *line, unsigned version)
 {
     event_init(e, NULL_DATE, NULL_TIME, -1, NULL, NULL, NULL, NULL, 0);
     char *tok;
 
+    if (version >= 3) {
+        if ((tok = csv_next_tok(&line))) {
+            e->id = strtoull(tok, NULL, 10);
+            free(tok);
+        }
+        else return -1;
+    }
+
     if ((tok = csv_next_tok(&line))) {
         event_set_date(e, date_from_str(tok));
         free(tok);
@@ -37,6 +123,15 @@ static int read_event(Event *e, char *line)
     }
     else return -1;
 
+    if (version >= 4) {
+        if ((tok = csv_next_tok(&line))) {
+            int minutes = duration_from_str(tok);
+            event_set_duration(e, minutes == -1 ? 0 : minutes);
+            free(tok);
+        }
+        else return -1;
+    }
+
     if ((tok = csv_next_tok(&line))) {
         event_set_priority(e, priority_from_str(tok));
         free(tok);
@@ -61,6 +156,17 @@ static int read_event(Event *e, char *line)
     }
     else return -1;
 
+    if (version >= 2) {
+        if ((tok = csv_next_tok(&line))) {
+            Recurrence r = recur_from_str(tok);
+            free(tok);
+            if (!recur_validate(r))
+                return -1;
+            event_set_recurrence(e, r);
+        }
+        else return -1;
+    }
+
     while (*line) {
         tok = csv_next_tok(&line);
         if (!tok)
@@ -72,45 +178,90 @@ static int read_event(Event *e, char *line)
     return 0;
 }
 
-int database_load(Database *db, FILE *f)
+void database_reader_init(DbReader *r, FILE *f)
 {
-    database_init(db);
+    r->f = f;
+    r->version = 1;
+    r->next_id = 1;
+    r->generation = 0;
+    r->line_no = 0;
+    r->line = NULL;
+    r->size = 0;
+    r->pending = false;
+}
 
-    unsigned line_no = 0;
-    size_t size = 0;
-    char *line = NULL;
-    do {
-        line_no++;
-        if (csv_get_row(&line, &size, f) == -1) {
-            if (feof(f)) {
-                break;
-            } else {
-                fprintf(stderr, "Error reading file on line %d!\n", line_no);
-                return -1;
+void database_reader_destroy(DbReader *r)
+{
+    free(r->line);
+    r->line = NULL;
+}
+
+/* Reads the header of the file, if it has one, so that its fields are
+ * known before any events are read. Returns -1 on error. */
+int database_reader_header(DbReader *r)
+{
+    if (r->line_no)
+        return 0;
+
+    r->line_no++;
+    if (csv_get_row(&r->line, &r->size, r->f) == -1)
+        return feof(r->f) ? 0 : -1;
+    //the first row is an event, keep it for database_reader_next
+    if (!read_header(r, r->line))
+        r->pending = true;
+    return 0;
+}
+
+/* Reads the next event of the file into *e. Returns 1 on success, 0 at
+ * end of file, and -1 on error. */
+int database_reader_next(DbReader *r, Event *e)
+{
+    for (;;) {
+        if (r->pending) {
+            r->pending = false;
+        } else if (feof(r->f)) {
+            return 0;
+        } else {
+            r->line_no++;
+            if (csv_get_row(&r->line, &r->size, r->f) == -1) {
+                if (feof(r->f)) {
+                    return 0;
+                } else {
+                    fprintf(stderr, "Error reading file on line %u!\n", r->line_no);
+                    return -1;
+                }
             }
+
+            if (r->line_no == 1 && read_header(r, r->line))
+                continue;
         }
 
-        Event e;
-        if (read_event(&e, line) != -1) {
-            database_add_event(db, e);
-        } else {
-            fprintf(stderr, "Error reading file on line %d!\n", line_no);
+        if (read_event(e, r->line, r->version) == -1) {
+            fprintf(stderr, "Error reading file on line %u!\n", r->line_no);
             return -1;
         }
-    } while (!feof(f));
-    free(line);
-
-    db->modified = false;
-    return 0;
+        return 1;
+    }
 }
 
-static unsigned max_tags(Database *db)
+int database_load(Database *db, FILE *f)
 {
-    unsigned ct = 0;
-    for (unsigned i = 0; i < db->count; i++) {
-        ct = MAX(ct, db->events[i].ntags);
-    }
-    return ct;
+    database_init(db);
+
+    DbReader r;
+    database_reader_init(&r, f);
+
+    int err;
+    Event e;
+    while ((err = database_reader_next(&r, &e)) == 1)
+        database_add_event(db, e);
+    db->next_id = MAX(db->next_id, r.next_id);
+    db->generation = r.generation;
+    database_reader_destroy(&r);
+
+    idmap_clear(&db->dirty);
+    db->modified = false;
+    return err;
 }
 
 static char *write_event(Event e, char **line, size_t *size, unsigned max_tags)
@@ -120,18 +271,28 @@ static char *write_event(Event e, char **line, size_t *size, unsigned max_tags)
     char *empty = "";
     char *tok;
 
-    if (!date_is_null(e.date)) {
-        tok = date_to_str(e.date);
-        csv_cat_tok(line, size, tok);
-        free(tok);
+    char id[32];
+    sprintf(id, "%" PRIu64, e.id);
+    csv_cat_tok(line, size, id);
+
+    char buf[DATE_STR_LEN];
+    if (date_validate(e.date)) {
+        date_format(e.date, buf);
+        csv_cat_tok(line, size, buf);
     } else {
         csv_cat_tok(line, size, empty);
     }
 
-    if (!time_is_null(e.time)) {
-        tok = time_to_str(e.time);
-        csv_cat_tok(line, size, tok);
-        free(tok);
+    if (time_validate(e.time)) {
+        time_format(e.time, buf);
+        csv_cat_tok(line, size, buf);
+    } else {
+        csv_cat_tok(line, size, empty);
+    }
+
+    if (e.duration) {
+        duration_format(e.duration, buf);
+        csv_cat_tok(line, size, buf);
     } else {
         csv_cat_tok(line, size, empty);
     }
@@ -157,6 +318,10 @@ static char *write_event(Event e, char **line, size_t *size, unsigned max_tags)
     else
         csv_cat_tok(line, size, empty);
 
+    tok = recur_to_str(e.recur);
+    csv_cat_tok(line, size, tok);
+    free(tok);
+
     for (unsigned i = 0; i < max_tags; i++)
         csv_cat_tok(line, size,
                     (e.tags && i < e.ntags) ? e.tags[i] : empty);
@@ -164,18 +329,111 @@ static char *write_event(Event e, char **line, size_t *size, unsigned max_tags)
     return *line;
 }
 
-int database_save(Database *db, FILE *f)
+static void write_header(FILE *f, uint64_t next_id, uint64_t generation)
+{
+    size_t size = 0;
+    char *line = NULL;
+    csv_cat_tok(&line, &size, DB_MAGIC);
+    char version[32];
+    sprintf(version, "version=%u", DB_VERSION);
+    csv_cat_tok(&line, &size, version);
+    char buf[48];
+    sprintf(buf, "next_id=%" PRIu64, next_id);
+    csv_cat_tok(&line, &size, buf);
+    sprintf(buf, "generation=%" PRIu64, generation);
+    csv_cat_tok(&line, &size, buf);
+    fprintf(f, "%s\n", line);
+    free(line);
+}
+
+static void write_row(FILE *f, Event e, unsigned max_tags)
 {
     size_t size;
     char *line;
-    unsigned mx_tgs = max_tags(db);
-    for (unsigned i = 0; i < db->count; i++) {
-        write_event(db->events[i], &line, &size, mx_tgs);
-        fprintf(f, "%s\n", line);
-    }
+    write_event(e, &line, &size, max_tags);
+    fprintf(f, "%s\n", line);
+    free(line);
+}
+
+int database_save(Database *db, FILE *f)
+{
+    unsigned mx_tgs = 0;
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));)
+        mx_tgs = MAX(mx_tgs, e->ntags);
+
+    write_header(f, db->next_id, db->generation);
+    it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));)
+        write_row(f, *e, mx_tgs);
 
+    idmap_clear(&db->dirty);
     db->modified = false;
-    return 0;
+    return ferror(f) ? -1 : 0;
+}
+
+/* Takes a snapshot of the events to save, in time linear in their
+ * number but without copying any strings. Events removed or replaced
+ * from then on are kept until the snapshot is released, and changes are
+ * tracked anew, so the snapshot holds those saved by writing it. */
+void database_snapshot(Database *db, DbSnapshot *snap)
+{
+    size_t count = store_count(db->events);
+    snap->events = malloc(count * sizeof(snap->events[0]));
+    if (!snap->events && count)
+        FATAL("Failed to allocate snapshot!");
+    size_t n = 0;
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));)
+        snap->events[n++] = *e;
+
+    snap->count = n;
+    snap->next_id = db->next_id;
+    snap->generation = db->generation + 1;
+    snap->revision = db->revision;
+    snap->dirty = db->dirty;
+    idmap_init(&db->dirty);
+    db->pinned++;
+}
+
+/* Writes a snapshot as a database file. Only reads the snapshot, so may
+ * run on another thread while its database is changed. */
+int database_save_snapshot(const DbSnapshot *snap, FILE *f)
+{
+    unsigned mx_tgs = 0;
+    for (size_t i = 0; i < snap->count; i++)
+        mx_tgs = MAX(mx_tgs, snap->events[i].ntags);
+
+    write_header(f, snap->next_id, snap->generation);
+    for (size_t i = 0; i < snap->count; i++)
+        write_row(f, snap->events[i], mx_tgs);
+    return ferror(f) ? -1 : 0;
+}
+
+/* Releases a snapshot once written, or once writing it failed or was
+ * given up, in which case the changes it held are unsaved again. The
+ * database counts as saved only if it hasn't changed since. */
+void database_release(Database *db, DbSnapshot *snap, bool saved)
+{
+    if (saved) {
+        db->generation = snap->generation;
+        if (db->revision == snap->revision)
+            db->modified = false;
+    } else if (snap->dirty.count) {
+        //the fingerprints as of the snapshot's base are the older ones
+        for (size_t i = 0; i < snap->dirty.cap; i++) {
+            if (snap->dirty.keys[i])
+                idmap_set(&db->dirty, snap->dirty.keys[i], snap->dirty.vals[i]);
+        }
+        db->modified = true;
+    }
+    idmap_destroy(&snap->dirty);
+    free(snap->events);
+    snap->events = NULL;
+    snap->count = 0;
+
+    if (!--db->pinned)
+        destroy_retired(db);
 }
 
 bool database_is_modified(Database *db)
@@ -183,93 +441,1096 @@ bool database_is_modified(Database *db)
     return db->modified;
 }
 
-void database_add_event(Database *db, Event e)
+/* Whether the event with the given id was added, changed or removed
+ * since the file was last loaded or saved. If so, *base is set to its
+ * fingerprint as of then, or 0 if it was added since. */
+bool database_is_dirty(Database *db, uint64_t id, uint64_t *base)
+{
+    size_t hash;
+    if (!idmap_get(&db->dirty, id, &hash))
+        return false;
+    *base = hash;
+    return true;
+}
+
+/* Marks an event as matching the file again, e.g. after applying a
+ * change read from the file */
+void database_mark_clean(Database *db, uint64_t id)
 {
-    unsigned i;
-    for (i = 0; i < db->count && event_sort_time(db->events[i], e) < 0; i++);
-    db->events = add_element(db->events, &db->count, sizeof(db->events[0]), i, &e);
+    idmap_remove(&db->dirty, id);
+    if (!db->dirty.count)
+        db->modified = false;
+}
+
+/* Returns the stored event with the given id and sets *i to its
+ * position, or returns NULL. The id map gives its date and time, so only
+ * events at that time are searched. */
+static Event *find_id(Database *db, uint64_t id, size_t *i)
+{
+    size_t key;
+    if (!idmap_get(&db->ids, id, &key))
+        return NULL;
+
+    *i = store_lower_bound(db->events, key);
+    StoreIter it = store_iter(db->events, *i);
+    for (Event *e; (e = store_next(&it)) && event_sort_key(*e) == key; ++*i) {
+        if (e->id == id)
+            return e;
+    }
+    return NULL;
+}
+
+/* Marks the event with the given id as changed since the file was last
+ * loaded or saved, remembering the fingerprint it had then, or 0 if it
+ * was not in the file */
+static void touch(Database *db, uint64_t id, uint64_t base)
+{
+    size_t unused;
+    if (!idmap_get(&db->dirty, id, &unused))
+        idmap_set(&db->dirty, id, base);
     db->modified = true;
+    db->revision++;
+}
+
+/* Frees the strings of an event leaving the database, or holds on to
+ * them while a snapshot may share them */
+static void retire(Database *db, Event *e)
+{
+    if (!db->pinned) {
+        event_destroy(e);
+        return;
+    }
+    db->retired = add_element(db->retired, &db->nretired, sizeof(db->retired[0]),
+                              db->nretired, e);
 }
 
+static void link_event(Database *db, Event e)
+{
+    if (event_is_recurring(e)) {
+        db->recurring = add_element(db->recurring, &db->nrecurring,
+                                    sizeof(db->recurring[0]), db->nrecurring, &e);
+        db->series_stale = true;
+    } else if (!date_is_null(e.date))
+        daystats_add(&db->days, e.date, e.priority);
+    Interval iv = {.id = e.id};
+    if (!event_is_recurring(e) && event_span(e, &iv.start, &iv.end))
+        itree_insert(&db->busy, iv);
+    for (unsigned j = 0; j < e.ntags; j++) {
+        trie_insert(&db->tags, e.tags[j]);
+        int bit = tag_lookup(e.tags[j]);
+        if (bit != -1)
+            idmap_set(&db->postings[bit], e.id, 0);
+    }
+}
+
+static void unlink_event(Database *db, Event e)
+{
+    if (event_is_recurring(e)) {
+        for (unsigned j = 0; j < db->nrecurring; j++) {
+            if (db->recurring[j].id == e.id) {
+                remove_element(db->recurring, &db->nrecurring, sizeof(db->recurring[0]), j);
+                break;
+            }
+        }
+        db->series_stale = true;
+    } else if (!date_is_null(e.date)) {
+        daystats_remove(&db->days, e.date, e.priority);
+    }
+    Interval iv = {.id = e.id};
+    if (!event_is_recurring(e) && event_span(e, &iv.start, &iv.end))
+        itree_remove(&db->busy, iv);
+    for (unsigned j = 0; j < e.ntags; j++) {
+        trie_remove(&db->tags, e.tags[j]);
+        int bit = tag_lookup(e.tags[j]);
+        if (bit != -1)
+            idmap_remove(&db->postings[bit], e.id);
+    }
+}
+
+/* Adds e to the index of its priority */
+static void index_event(Database *db, Event e)
+{
+    if (priority_validate(e.priority) && !event_is_recurring(e))
+        store_insert(db->by_priority[e.priority], e);
+}
+
+static void unindex_event(Database *db, Event e)
+{
+    if (!priority_validate(e.priority) || event_is_recurring(e))
+        return;
+
+    EventStore *s = db->by_priority[e.priority];
+    uint64_t key = event_sort_key(e);
+    size_t i = store_lower_bound(s, key);
+    StoreIter it = store_iter(s, i);
+    for (Event *x; (x = store_next(&it)) && event_sort_key(*x) == key; i++) {
+        if (x->id == e.id) {
+            store_remove(s, i);
+            return;
+        }
+    }
+}
+
+/* Rebuilds the priority indexes in one pass, for after the events were
+ * replaced at once */
+static void reindex(Database *db)
+{
+    Event *lists[URGENT + 1];
+    size_t n[URGENT + 1] = {0};
+
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));) {
+        if (priority_validate(e->priority) && !event_is_recurring(*e))
+            n[e->priority]++;
+    }
+    for (unsigned p = LOW; p <= URGENT; p++) {
+        lists[p] = malloc(n[p] * sizeof(lists[p][0]));
+        if (!lists[p] && n[p])
+            FATAL("Failed to allocate priority index!");
+        n[p] = 0;
+    }
+
+    it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));) {
+        if (priority_validate(e->priority) && !event_is_recurring(*e))
+            lists[e->priority][n[e->priority]++] = *e;
+    }
+    for (unsigned p = LOW; p <= URGENT; p++)
+        store_assign(db->by_priority[p], lists[p], n[p]);
+}
+
+/* Adds e to the database, taking ownership of its strings. Events
+ * without an id, or whose id is taken, are assigned a new one, and the
+ * id is returned. */
+static uint64_t assign_id(Database *db, uint64_t id)
+{
+    size_t taken;
+    if (!id || idmap_get(&db->ids, id, &taken))
+        return db->next_id++;
+    db->next_id = MAX(db->next_id, id + 1);
+    return id;
+}
+
+uint64_t database_add_event(Database *db, Event e)
+{
+    e.id = assign_id(db, e.id);
+    store_insert(db->events, e);
+    idmap_set(&db->ids, e.id, event_sort_key(e));
+
+    index_event(db, e);
+    link_event(db, e);
+    touch(db, e.id, 0);
+    return e.id;
+}
+
+/* Returns index of e in the database, by id if it has one. Occurrences
+ * of recurring events share the id of the event they came from. */
 static int get_event_index(Database *db, Event e)
 {
-    for (unsigned i = 0; i < db->count; i++) {
-        if (event_equal(db->events[i], e))
+    size_t i;
+    if (e.id)
+        return find_id(db, e.id, &i) ? (int)i : -1;
+
+    StoreIter it = store_iter(db->events, 0);
+    i = 0;
+    for (Event *stored; (stored = store_next(&it)); i++) {
+        Event occ = *stored;
+        if (event_is_recurring(occ) && recur_occurs_on(occ.recur, occ.date, e.date))
+            event_set_date(&occ, e.date);
+        if (event_equal(occ, e))
             return i;
     }
     return -1;
 }
 
+static void remove_index(Database *db, size_t i)
+{
+    Event *e = store_at(db->events, i);
+    touch(db, e->id, e->hash);
+    unindex_event(db, *e);
+    unlink_event(db, *e);
+    idmap_remove(&db->ids, e->id);
+    retire(db, e);
+    store_remove(db->events, i);
+}
+
 int database_remove_event(Database *db, Event e)
 {
     int i = get_event_index(db, e);
     if (i >= 0) {
-        event_destroy(&db->events[i]);
-        remove_element(db->events, &db->count, sizeof(db->events[0]), i);
-        db->modified = true;
+        remove_index(db, i);
         return 0;
     } else {
         return -1;
     }
 }
 
-int database_query_date(Database *db, Date d, Event **events, size_t *size)
+/* Replaces the stored event with the same id as e, taking ownership of
+ * e's strings. Updated in place unless its date or time changed. */
+int database_update_event(Database *db, Event e)
+{
+    size_t i;
+    Event *stored = find_id(db, e.id, &i);
+    if (!stored)
+        return -1;
+
+    if (event_sort_time(*stored, e)) {
+        remove_index(db, i);
+        database_add_event(db, e);
+    } else {
+        touch(db, e.id, stored->hash);
+        unindex_event(db, *stored);
+        unlink_event(db, *stored);
+        retire(db, stored);
+        *stored = e;
+        index_event(db, e);
+        link_event(db, e);
+    }
+    return 0;
+}
+
+/* Returns the stored event with the given id, or NULL */
+Event *database_get_event(Database *db, uint64_t id)
+{
+    size_t i;
+    return find_id(db, id, &i);
+}
+
+size_t database_count(Database *db)
+{
+    return store_count(db->events);
+}
+
+/* Returns whether e is identical to one of the events of out[from, n),
+ * which all share its date and time */
+static bool in_run(Event *out, size_t from, size_t n, Event e)
+{
+    for (size_t i = from; i < n; i++) {
+        if (event_equal(out[i], e))
+            return true;
+    }
+    return false;
+}
+
+/* Merges the events of other into db in a single pass over both sorted
+ * arrays, skipping events db already has. Merged events are given new
+ * ids. other is destroyed. Returns the number of events added. */
+size_t database_merge(Database *db, Database *other)
+{
+    size_t count = store_count(db->events);
+    size_t other_count = store_count(other->events);
+    size_t n = 0;
+    size_t added = 0;
+    size_t run = 0; //start of events in out at the current date and time
+    Event *out = malloc((count + other_count) * sizeof(out[0]));
+    if (!out && count + other_count)
+        FATAL("Failed to allocate merged events!");
+
+    StoreIter i = store_iter(db->events, 0);
+    StoreIter j = store_iter(other->events, 0);
+    Event *a = store_next(&i), *b = store_next(&j);
+    while (a || b) {
+        bool from_other = !a || (b && event_sort_time(*b, *a) < 0);
+        Event e;
+        if (from_other) {
+            e = *b;
+            b = store_next(&j);
+        } else {
+            e = *a;
+            a = store_next(&i);
+        }
+
+        if (!n || event_sort_time(out[n - 1], e))
+            run = n;
+
+        if (from_other) {
+            //events of db at the same time come first, so are in the run
+            if (in_run(out, run, n, e)) {
+                event_destroy(&e);
+                continue;
+            }
+            e.id = db->next_id++;
+            idmap_set(&db->ids, e.id, event_sort_key(e));
+            link_event(db, e);
+            touch(db, e.id, 0);
+            added++;
+        }
+        out[n++] = e;
+    }
+    store_assign(db->events, out, n);
+    reindex(db);
+
+    //events were moved out of other
+    store_assign(other->events, NULL, 0);
+    database_destroy(other);
+    return added;
+}
+
+/* Removes events identical to an earlier one in a single pass, keyed
+ * by fingerprint. Returns the number of events removed. */
+size_t database_dedup(Database *db)
+{
+    IdMap seen;
+    idmap_init(&seen);
+
+    size_t count = store_count(db->events);
+    Event *kept = malloc(count * sizeof(kept[0]));
+    if (!kept && count)
+        FATAL("Failed to allocate events!");
+
+    size_t n = 0;
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *stored; (stored = store_next(&it));) {
+        Event e = *stored;
+        uint64_t key = e.hash ? e.hash : 1; //0 marks an empty slot
+        size_t j;
+        if (idmap_get(&seen, key, &j) && event_equal(kept[j], e)) {
+            touch(db, e.id, e.hash);
+            unlink_event(db, e);
+            idmap_remove(&db->ids, e.id);
+            retire(db, &e);
+            continue;
+        }
+        //keep the first event seen with a fingerprint on collision
+        if (!idmap_get(&seen, key, &j))
+            idmap_set(&seen, key, n);
+        kept[n++] = e;
+    }
+    idmap_destroy(&seen);
+    store_assign(db->events, kept, n);
+    reindex(db);
+
+    return count - n;
+}
+
+static int append_event(Event **events, size_t *size, Event e)
+{
+    if (!(*events = realloc(*events, ++*size * sizeof((*events)[0]))))
+        return -1;
+    (*events)[*size - 1] = e;
+    return 0;
+}
+
+static int sort_wrapper(const void *a, const void *b)
 {
-    if (!events || !date_validate(d))
+    return event_sort_time(*(Event *)a, *(Event *)b);
+}
+
+/* Changes every event matching match with change in a single pass. The
+ * events whose date or time changed are sorted on their own and merged
+ * back with the rest at once, ahead of events at the same time as
+ * database_update_event would place them. change must keep the id and
+ * use the event setters. Returns the number of events changed. */
+size_t database_update_where(Database *db, event_match_fn match, event_change_fn change, void *data)
+{
+    Event *moved = NULL;
+    size_t nmoved = 0, cap = 0, matched = 0, changed = 0;
+
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));) {
+        if (!match(*e, data))
+            continue;
+
+        matched++;
+        uint64_t hash = e->hash;
+        uint64_t key = event_sort_key(*e);
+        unlink_event(db, *e);
+        if (db->pinned) {
+            //the setters free the strings a snapshot shares
+            Event old = *e;
+            event_clone(e, old);
+            retire(db, &old);
+        }
+        change(e, data);
+        link_event(db, *e);
+        if (e->hash != hash) {
+            touch(db, e->id, hash);
+            changed++;
+        }
+        if (event_sort_key(*e) == key)
+            continue;
+
+        idmap_set(&db->ids, e->id, event_sort_key(*e));
+        if (nmoved == cap) {
+            cap = cap ? cap * 2 : 64;
+            moved = realloc(moved, cap * sizeof(moved[0]));
+            if (!moved)
+                FATAL("Failed to allocate events!");
+        }
+        moved[nmoved++] = *e;
+        e->id = 0; //left behind, to be skipped below
+    }
+
+    if (nmoved) {
+        qsort(moved, nmoved, sizeof(moved[0]), sort_wrapper);
+
+        size_t count = store_count(db->events);
+        Event *out = malloc(count * sizeof(out[0]));
+        if (!out)
+            FATAL("Failed to allocate events!");
+        size_t j = 0, k = 0;
+        it = store_iter(db->events, 0);
+        for (Event *e = store_next(&it); e || j < nmoved;) {
+            if (e && !e->id) {
+                e = store_next(&it);
+            } else if (j < nmoved && (!e || event_sort_time(moved[j], *e) <= 0)) {
+                out[k++] = moved[j++];
+            } else {
+                out[k++] = *e;
+                e = store_next(&it);
+            }
+        }
+        store_assign(db->events, out, k);
+    }
+    free(moved);
+    //the index and cached results hold copies of the old strings even if
+    //nothing changed, which the setters or destroy_retired may free
+    if (matched) {
+        reindex(db);
+        db->revision++;
+    }
+    return changed;
+}
+
+/* Starts adding many events at once. Events added with database_bulk_add
+ * are held unsorted until database_bulk_end sorts them into place, and
+ * the database must not be used otherwise in between. */
+void database_bulk_begin(Database *db)
+{
+    db->nbulk = 0;
+}
+
+uint64_t database_bulk_add(Database *db, Event e)
+{
+    e.id = assign_id(db, e.id);
+
+    if (db->nbulk == db->bulk_cap) {
+        db->bulk_cap = db->bulk_cap ? db->bulk_cap * 2 : 64;
+        db->bulk = realloc(db->bulk, db->bulk_cap * sizeof(db->bulk[0]));
+        if (!db->bulk)
+            FATAL("Failed to allocate events!");
+    }
+    db->bulk[db->nbulk++] = e;
+    idmap_set(&db->ids, e.id, event_sort_key(e));
+
+    link_event(db, e);
+    touch(db, e.id, 0);
+    return e.id;
+}
+
+/* Sort key of an added event, with its position breaking ties so that
+ * sorting is stable */
+typedef struct BulkSlot {
+    uint64_t key;
+    size_t i;
+} BulkSlot;
+
+static int slot_compare(const void *a, const void *b)
+{
+    const BulkSlot *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->i < y->i ? -1 : x->i > y->i;
+}
+
+/* Sorts the added events and merges them with the rest in one pass */
+void database_bulk_end(Database *db)
+{
+    size_t n = db->nbulk;
+    if (!n)
+        return;
+
+    BulkSlot *slots = malloc(n * sizeof(slots[0]));
+    if (!slots)
+        FATAL("Failed to allocate events!");
+    for (size_t i = 0; i < n; i++)
+        slots[i] = (BulkSlot){event_sort_key(db->bulk[i]), i};
+    qsort(slots, n, sizeof(slots[0]), slot_compare);
+
+    size_t count = store_count(db->events);
+    Event *out = malloc((count + n) * sizeof(out[0]));
+    if (!out)
+        FATAL("Failed to allocate events!");
+
+    //added events go before the stored ones at the same time, as
+    //store_insert puts them, but keep the order they were added in
+    size_t k = 0, j = 0;
+    StoreIter it = store_iter(db->events, 0);
+    Event *e = store_next(&it);
+    while (e || j < n) {
+        if (e && (j == n || event_sort_key(*e) < slots[j].key)) {
+            out[k++] = *e;
+            e = store_next(&it);
+        } else {
+            out[k++] = db->bulk[slots[j++].i];
+        }
+    }
+    store_assign(db->events, out, k);
+    reindex(db);
+
+    free(slots);
+    free(db->bulk);
+    db->bulk = NULL;
+    db->nbulk = 0;
+    db->bulk_cap = 0;
+}
+
+/* Appends occurrences of recurring events between from and to
+ * inclusive to *events. Occurrences share strings with the database. */
+static int add_occurrences(Database *db, Date from, Date to, Event **events, size_t *size)
+{
+    for (unsigned i = 0; i < db->nrecurring; i++) {
+        Event o = db->recurring[i];
+        for (Date d = recur_next(o.recur, o.date, from);
+             !date_is_null(d) && date_compare(d, to) <= 0;
+             d = recur_next(o.recur, o.date, date_add_days(d, 1))) {
+            Event occ = o;
+            event_set_date(&occ, d);
+            if (append_event(events, size, occ) == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int database_query_range(Database *db, Date from, Date to, Event **events, size_t *size)
+{
+    if (!events || !date_validate(from) || !date_validate(to))
         return -1;
 
+    char key[2 * DATE_STR_LEN + 6] = "range ";
+    date_format(from, key + 6);
+    key[5 + DATE_STR_LEN] = ' ';
+    date_format(to, key + 6 + DATE_STR_LEN);
+    if (qcache_get(&db->cache, key, db->revision, events, size))
+        return 0;
+
     *events = NULL;
     *size = 0;
 
-    for (unsigned i = 0; i < db->count; i++) {
-        if (!date_compare(db->events[i].date, d)) {
-            if (!(*events = realloc(*events, ++*size * sizeof((*events)[0]))))
-                return -1;
-            (*events)[*size - 1] = db->events[i];
-        } else if(date_compare(db->events[i].date, d) > 0)
-            break;
+    Event start = {.date = from, .time = NULL_TIME};
+    StoreIter it = store_iter(db->events, store_lower_bound(db->events, event_sort_key(start)));
+    for (Event *e; (e = store_next(&it)) && date_compare(e->date, to) <= 0;) {
+        if (!event_is_recurring(*e) && append_event(events, size, *e) == -1)
+            return -1;
     }
 
+    size_t nplain = *size;
+    if (add_occurrences(db, from, to, events, size) == -1)
+        return -1;
+    if (*size > nplain)
+        qsort(*events, *size, sizeof((*events)[0]), sort_wrapper);
+
+    qcache_put(&db->cache, key, db->revision, *events, *size);
     return 0;
 }
 
+int database_query_date(Database *db, Date d, Event **events, size_t *size)
+{
+    return database_query_range(db, d, d, events, size);
+}
+
 int database_query_date_and_time(Database *db, Date d, Time t, Event **events, size_t *size)
 {
-    if (!events || !date_validate(d))
+    if (database_query_date(db, d, events, size) == -1)
+        return -1;
+
+    size_t n = 0;
+    for (unsigned i = 0; i < *size; i++) {
+        if (!time_compare((*events)[i].time, t))
+            (*events)[n++] = (*events)[i];
+    }
+    *size = n;
+
+    return 0;
+}
+
+/* Lists every stored event in order, recurring events once */
+int database_query_all(Database *db, Event **events, size_t *size)
+{
+    if (!events)
+        return -1;
+
+    *size = store_count(db->events);
+    *events = malloc(*size * sizeof((*events)[0]));
+    if (!*events && *size)
+        return -1;
+
+    size_t i = 0;
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));)
+        (*events)[i++] = *e;
+    return 0;
+}
+
+static bool node_before(const SeriesHeap *h, size_t a, size_t b)
+{
+    return h->nodes[a].key < h->nodes[b].key;
+}
+
+static void series_sift_down(SeriesHeap *h, size_t i)
+{
+    for (;;) {
+        size_t first = i;
+        for (size_t c = 2 * i + 1; c < h->count && c <= 2 * i + 2; c++) {
+            if (node_before(h, c, first))
+                first = c;
+        }
+        if (first == i)
+            return;
+        struct SeriesNode tmp = h->nodes[i];
+        h->nodes[i] = h->nodes[first];
+        h->nodes[first] = tmp;
+        i = first;
+    }
+}
+
+/* Rebuilds the series heaps keyed from the given date, in time linear in
+ * the number of recurring events */
+static void build_series(Database *db, Date from)
+{
+    for (unsigned p = LOW; p <= URGENT; p++)
+        db->series[p].count = 0;
+
+    for (size_t i = 0; i < db->nrecurring; i++) {
+        Event o = db->recurring[i];
+        Date d = recur_next(o.recur, o.date, from);
+        if (!priority_validate(o.priority) || date_is_null(d))
+            continue;
+
+        SeriesHeap *h = &db->series[o.priority];
+        if (h->count == h->cap) {
+            h->cap = h->cap ? h->cap * 2 : 16;
+            h->nodes = realloc(h->nodes, h->cap * sizeof(h->nodes[0]));
+            if (!h->nodes)
+                FATAL("Failed to allocate series heap!");
+        }
+        o.date = d;
+        h->nodes[h->count++] = (struct SeriesNode){d, event_sort_key(o), i};
+    }
+    for (unsigned p = LOW; p <= URGENT; p++) {
+        for (size_t i = db->series[p].count / 2; i-- > 0;)
+            series_sift_down(&db->series[p], i);
+    }
+    db->series_from = from;
+    db->series_stale = false;
+}
+
+/* Keys the series heaps from the given date. Moving forward only rekeys
+ * the series with an occurrence in between, so as the date an agenda
+ * starts from advances day by day, each occurrence is passed over once.
+ * The heaps are rebuilt after recurring events change, or to move back. */
+static void key_series(Database *db, Date from)
+{
+    if (db->series_stale || date_compare(from, db->series_from) < 0) {
+        build_series(db, from);
+        return;
+    }
+
+    for (unsigned p = LOW; p <= URGENT; p++) {
+        SeriesHeap *h = &db->series[p];
+        while (h->count && date_compare(h->nodes[0].next, from) < 0) {
+            Event o = db->recurring[h->nodes[0].i];
+            Date d = recur_next(o.recur, o.date, from);
+            o.date = d;
+            if (date_is_null(d))
+                h->nodes[0] = h->nodes[--h->count];
+            else
+                h->nodes[0] = (struct SeriesNode){d, event_sort_key(o), h->nodes[0].i};
+            series_sift_down(h, 0);
+        }
+    }
+    db->series_from = from;
+}
+
+/* Earliest event not yet taken from one of the lists an agenda merges:
+ * a priority index, or the occurrences of a recurring series */
+typedef struct AgendaHead {
+    Event e;
+    StoreIter it;
+    Date start; //of the series
+    bool series;
+    const SeriesHeap *heap; //holding the series, whose children there are
+    size_t node;            //merged in once its first occurrence is taken
+    bool entered;
+} AgendaHead;
+
+static bool head_before(const AgendaHead *a, const AgendaHead *b)
+{
+    int cmp = event_sort_time(a->e, b->e);
+    return cmp ? cmp < 0 : a->e.priority > b->e.priority;
+}
+
+static void sift_down(AgendaHead *heap, size_t n, size_t i)
+{
+    for (;;) {
+        size_t first = i;
+        for (size_t c = 2 * i + 1; c < n && c <= 2 * i + 2; c++) {
+            if (head_before(&heap[c], &heap[first]))
+                first = c;
+        }
+        if (first == i)
+            return;
+        AgendaHead tmp = heap[i];
+        heap[i] = heap[first];
+        heap[first] = tmp;
+        i = first;
+    }
+}
+
+static void sift_up(AgendaHead *heap, size_t i)
+{
+    while (i > 0 && head_before(&heap[i], &heap[(i - 1) / 2])) {
+        AgendaHead tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+/* Moves h on to the next event of its list. Returns false at the end. */
+static bool head_advance(AgendaHead *h)
+{
+    if (h->series) {
+        Date d = recur_next(h->e.recur, h->start, date_add_days(h->e.date, 1));
+        if (date_is_null(d))
+            return false;
+        event_set_date(&h->e, d);
+        return true;
+    }
+
+    Event *e = store_next(&h->it);
+    if (e)
+        h->e = *e;
+    return e != NULL;
+}
+
+/* Adds the series at a node of a series heap to the agenda heap */
+static int push_series(Database *db, AgendaHead **heap, size_t *n, size_t *cap,
+                       const SeriesHeap *h, size_t node)
+{
+    if (*n == *cap) {
+        *cap *= 2;
+        AgendaHead *grown = realloc(*heap, *cap * sizeof(grown[0]));
+        if (!grown)
+            return -1;
+        *heap = grown;
+    }
+
+    AgendaHead *head = &(*heap)[*n];
+    head->series = true;
+    head->heap = h;
+    head->node = node;
+    head->entered = false;
+    head->e = db->recurring[h->nodes[node].i];
+    head->start = head->e.date;
+    event_set_date(&head->e, h->nodes[node].next);
+    sift_up(*heap, (*n)++);
+    return 0;
+}
+
+/* Lists the first n events from the given date on of at least priority
+ * min, recurring events as their occurrences. Merges the priority
+ * indexes and the series on a heap, each index entered by binary search
+ * and the series of each priority by the root of its series heap. A
+ * series brings in its two children there once its first occurrence is
+ * taken, so only O(k) series are looked at for k events listed. */
+int database_query_agenda(Database *db, Date from, Priority min, size_t n,
+                          Event **events, size_t *size)
+{
+    if (!events || !date_validate(from) || !priority_validate(min))
         return -1;
 
     *events = NULL;
     *size = 0;
+    key_series(db, from);
 
-    for (unsigned i = 0; i < db->count; i++) {
-        int dc = date_compare(db->events[i].date, d);
-        int tc = time_compare(db->events[i].time, t);
-        if (!dc && !tc) {
-            if (!(*events = realloc(*events, ++*size * sizeof((*events)[0]))))
-                return -1;
-            (*events)[*size - 1] = db->events[i];
-        } else if((dc == 0 && tc > 0) || dc > 0)
+    size_t cap = 2 * (URGENT + 1);
+    AgendaHead *heap = malloc(cap * sizeof(heap[0]));
+    if (!heap)
+        return -1;
+    size_t nheap = 0;
+
+    Event start = {.date = from, .time = NULL_TIME};
+    for (unsigned p = min; p <= URGENT; p++) {
+        EventStore *s = db->by_priority[p];
+        AgendaHead *h = &heap[nheap];
+        h->series = false;
+        h->it = store_iter(s, store_lower_bound(s, event_sort_key(start)));
+        if (head_advance(h))
+            nheap++;
+    }
+    for (size_t i = nheap / 2; i-- > 0;)
+        sift_down(heap, nheap, i);
+    for (unsigned p = min; p <= URGENT; p++) {
+        if (db->series[p].count)
+            push_series(db, &heap, &nheap, &cap, &db->series[p], 0);
+    }
+
+    int err = 0;
+    while (nheap && *size < n && !err) {
+        if (append_event(events, size, heap[0].e) == -1) {
+            err = -1;
             break;
+        }
+
+        AgendaHead top = heap[0];
+        if (!head_advance(&heap[0]))
+            heap[0] = heap[--nheap];
+        else
+            heap[0].entered = true;
+        sift_down(heap, nheap, 0);
+
+        //the children of a series start no earlier than it, so need only
+        //be merged once it was taken from
+        if (top.series && !top.entered) {
+            for (size_t c = 2 * top.node + 1; c <= 2 * top.node + 2 && !err; c++) {
+                if (c < top.heap->count)
+                    err = push_series(db, &heap, &nheap, &cap, top.heap, c);
+            }
+        }
     }
 
-    return 0;
+    free(heap);
+    return err;
 }
 
-int database_query_tag(Database *db, const char *tag, Event **events, size_t *size)
+/* Adds tags with a bit to the mask, and returns how many of the rest
+ * were left in rare to be looked up by name */
+static size_t split_tags(const char *tags[], size_t n, TagMask *mask, const char **rare)
+{
+    size_t nrare = 0;
+    tagmask_clear(mask);
+    for (size_t i = 0; i < n; i++) {
+        int bit = tag_lookup(tags[i]);
+        if (bit != -1)
+            tagmask_set(mask, bit);
+        else
+            rare[nrare++] = tags[i];
+    }
+    return nrare;
+}
+
+static int strcmp_wrapper(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* Appends the sorted tags, each after sign, to key at *len */
+static void cat_tags(char *key, size_t *len, const char *tags[], size_t n, char sign)
+{
+    const char **sorted = malloc(n * sizeof(sorted[0]) + 1);
+    if (!sorted)
+        FATAL("Failed to allocate tags!");
+    memcpy(sorted, tags, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), strcmp_wrapper);
+    for (size_t i = 0; i < n; i++)
+        *len += sprintf(key + *len, " %c%s", sign, sorted[i]);
+    free(sorted);
+}
+
+/* Returns the cache key of a tag query, the same whatever the order of
+ * the tags */
+static char *tags_key(const char *all[], size_t nall, const char *none[], size_t nnone)
 {
-    if (!events || !tag || !*tag)
+    size_t len = 4;
+    for (size_t i = 0; i < nall; i++)
+        len += strlen(all[i]) + 2;
+    for (size_t i = 0; i < nnone; i++)
+        len += strlen(none[i]) + 2;
+
+    char *key = malloc(len + 1);
+    if (!key)
+        FATAL("Failed to allocate query key!");
+    strcpy(key, "tags");
+    len = 4;
+    cat_tags(key, &len, all, nall, '+');
+    cat_tags(key, &len, none, nnone, '-');
+    return key;
+}
+
+/* Finds the events carrying every tag in all and none of the tags in
+ * none. Tags with a bit are tested together on each event's mask; only
+ * rare tags fall back to searching its tag list. */
+int database_query_tags(Database *db,
+                        const char *all[], size_t nall,
+                        const char *none[], size_t nnone,
+                        Event **events, size_t *size)
+{
+    if (!events)
         return -1;
 
+    char *key = tags_key(all, nall, none, nnone);
+    if (qcache_get(&db->cache, key, db->revision, events, size)) {
+        free(key);
+        return 0;
+    }
+
     *events = NULL;
     *size = 0;
 
-    for (unsigned i = 0; i < db->count; i++) {
-        if (event_contains_tag(db->events[i], tag)) {
-            if (!(*events = realloc(*events, ++*size * sizeof((*events)[0]))))
+    const char **rare = malloc((nall + nnone) * sizeof(rare[0]) + 1);
+    if (!rare)
+        return -1;
+    TagMask all_mask, none_mask;
+    size_t nrare_all = split_tags(all, nall, &all_mask, rare);
+    size_t nrare_none = split_tags(none, nnone, &none_mask, rare + nrare_all);
+
+    int err = 0;
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; !err && (e = store_next(&it));) {
+        if (!tagmask_match(&e->tagmask, &all_mask, &none_mask))
+            continue;
+
+        bool match = true;
+        for (size_t i = 0; match && i < nrare_all; i++)
+            match = event_contains_tag(*e, rare[i]);
+        for (size_t i = nrare_all; match && i < nrare_all + nrare_none; i++)
+            match = !event_contains_tag(*e, rare[i]);
+        if (match)
+            err = append_event(events, size, *e);
+    }
+
+    if (!err)
+        qcache_put(&db->cache, key, db->revision, *events, *size);
+    free(key);
+    free(rare);
+    return err;
+}
+
+int database_query_tag(Database *db, const char *tag, Event **events, size_t *size)
+{
+    if (!tag || !*tag)
+        return -1;
+    return database_query_tags(db, &tag, 1, NULL, 0, events, size);
+}
+
+/* Fills counts with the events on each of the ndays days from from,
+ * read from the per-day counts and with occurrences of recurring events
+ * added */
+void database_day_counts(Database *db, Date from, size_t ndays, DayCount *counts)
+{
+    long first = date_to_days(from);
+    for (size_t i = 0; i < ndays; i++)
+        counts[i] = daystats_get(&db->days, first + i);
+    if (!ndays)
+        return;
+
+    Date to = date_from_days(first + ndays - 1);
+    for (size_t i = 0; i < db->nrecurring; i++) {
+        Event o = db->recurring[i];
+        for (Date d = recur_next(o.recur, o.date, from);
+             !date_is_null(d) && date_compare(d, to) <= 0;
+             d = recur_next(o.recur, o.date, date_add_days(d, 1))) {
+            DayCount *c = &counts[date_to_days(d) - first];
+            c->events++;
+            if (priority_validate(o.priority))
+                c->priorities[o.priority]++;
+        }
+    }
+}
+
+/* Returns the number of events between from and to inclusive, counting
+ * each occurrence of recurring events */
+size_t database_count_range(Database *db, Date from, Date to)
+{
+    size_t n = daystats_count(&db->days, date_to_days(from), date_to_days(to));
+    for (size_t i = 0; i < db->nrecurring; i++) {
+        Event o = db->recurring[i];
+        for (Date d = recur_next(o.recur, o.date, from);
+             !date_is_null(d) && date_compare(d, to) <= 0;
+             d = recur_next(o.recur, o.date, date_add_days(d, 1)))
+            n++;
+    }
+    return n;
+}
+
+/* Day of a minute since 01/01/1970, rounding down */
+static long day_of(int64_t minute)
+{
+    return (minute >= 0 ? minute : minute - DAY_MINUTES + 1) / DAY_MINUTES;
+}
+
+typedef struct Overlaps {
+    Database *db;
+    uint64_t skip;
+    Event *events;
+    size_t size;
+    int err;
+} Overlaps;
+
+static void add_overlap(Interval iv, void *data)
+{
+    Overlaps *o = data;
+    Event *e = iv.id != o->skip ? database_get_event(o->db, iv.id) : NULL;
+    if (e && append_event(&o->events, &o->size, *e) == -1)
+        o->err = -1;
+}
+
+/* Finds the events taking up any of the minutes since 01/01/1970 from
+ * start to end, with the occurrences of recurring events that do, in
+ * order of start. Events with the id skip are left out. Events share
+ * strings with the database. */
+int database_query_overlaps(Database *db, int64_t start, int64_t end, uint64_t skip,
+                            Event **events, size_t *size)
+{
+    if (!events)
+        return -1;
+
+    Overlaps o = {db, skip, NULL, 0, 0};
+    itree_overlaps(&db->busy, start, end, add_overlap, &o);
+    *events = o.events;
+    *size = o.size;
+    if (o.err == -1)
+        return -1;
+
+    //occurrences starting up to the longest duration before start
+    size_t nplain = *size;
+    Date from = date_from_days(day_of(start - DURATION_MAX));
+    Date to = date_from_days(day_of(end - 1));
+    for (size_t i = 0; i < db->nrecurring; i++) {
+        Event r = db->recurring[i];
+        if (r.id == skip || !r.duration || time_is_null(r.time))
+            continue;
+        for (Date d = recur_next(r.recur, r.date, from);
+             !date_is_null(d) && date_compare(d, to) <= 0;
+             d = recur_next(r.recur, r.date, date_add_days(d, 1))) {
+            Event occ = r;
+            event_set_date(&occ, d);
+            int64_t occ_start, occ_end;
+            event_span(occ, &occ_start, &occ_end);
+            if (occ_start < end && occ_end > start && append_event(events, size, occ) == -1)
                 return -1;
-            (*events)[*size - 1] = db->events[i];
         }
     }
+    if (*size > nplain)
+        qsort(*events, *size, sizeof((*events)[0]), sort_wrapper);
+    return 0;
+}
+
+/* Finds the gaps of at least min minutes on d between the events with
+ * a duration, sweeping over them in order of start */
+int database_free_slots(Database *db, Date d, unsigned min, Interval **slots, size_t *n)
+{
+    int64_t day = (int64_t)date_to_days(d) * DAY_MINUTES;
+    Event *events;
+    size_t nevents;
+    if (!slots || database_query_overlaps(db, day, day + DAY_MINUTES, 0, &events, &nevents) == -1)
+        return -1;
 
+    *slots = NULL;
+    *n = 0;
+    int64_t free_from = day;
+    for (size_t i = 0; i <= nevents; i++) {
+        int64_t start = day + DAY_MINUTES, end = start;
+        if (i < nevents)
+            event_span(events[i], &start, &end);
+        if (start - free_from >= MAX(min, 1)) {
+            Interval gap = {free_from, start, 0};
+            *slots = add_element(*slots, n, sizeof(gap), *n, &gap);
+        }
+        free_from = MAX(free_from, end);
+    }
+    free(events);
     return 0;
 }
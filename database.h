@@ -1,14 +1,84 @@
 #pragma once
 
 #include <stdlib.h>
+#include "daystats.h"
 #include "event.h"
+#include "idmap.h"
+#include "interval.h"
+#include "qcache.h"
+#include "store.h"
+#include "trie.h"
+
+/* Recurring series of one priority on a binary min-heap by their next
+ * occurrence, read by agendas */
+typedef struct SeriesHeap {
+    struct SeriesNode {
+        Date next;    //on or after Database.series_from
+        uint64_t key; //sort key of that occurrence
+        size_t i;     //position in Database.recurring
+    } *nodes;
+    size_t count;
+    size_t cap;
+} SeriesHeap;
 
 typedef struct Database {
     bool modified;
-    size_t count;
-    Event *events;
+    EventStore *events; //sorted by date and time
+    size_t nrecurring;
+    Event *recurring; //shallow copies of the recurring events in events
+    Trie tags;        //distinct tags of all events, for completion
+    IdMap *postings;  //ids of the events carrying each tag with a bit, by bit
+    EventStore *by_priority[URGENT + 1]; //shallow copies of the events of
+                                         //each priority that don't recur
+    SeriesHeap series[URGENT + 1]; //the recurring events of each priority
+    Date series_from;              //date the series heaps are keyed from
+    bool series_stale;             //recurring changed since they were built
+    uint64_t next_id;
+    uint64_t generation; //of the file as last loaded or saved
+    IdMap ids;           //event id to its sort key
+    Event *bulk;         //events awaiting database_bulk_end, unsorted
+    size_t nbulk;
+    size_t bulk_cap;
+    IdMap dirty;         //ids changed since the last load or save, to
+                         //their fingerprint as of then
+    uint64_t revision;   //bumped by every change to the events
+    QueryCache cache;    //results of recent queries, by revision
+    DayStats days;       //counts of the events that don't recur, by day
+    IntervalTree busy;   //spans of the events that don't recur and have
+                         //a duration
+    unsigned pinned;     //snapshots not yet released
+    Event *retired;      //events removed or replaced while pinned, whose
+    size_t nretired;     //strings a snapshot may still share
 } Database;
 
+/* Copy of the events of a database as of when it was taken, sharing
+ * their strings, to be written while the database goes on changing */
+typedef struct DbSnapshot {
+    Event *events; //shallow copies, sorted by date and time
+    size_t count;
+    uint64_t next_id;
+    uint64_t generation; //to write to the file
+    uint64_t revision;   //of the database when taken
+    IdMap dirty;         //ids changed before it was taken, moved out of
+                         //the database
+} DbSnapshot;
+
+/* Reads the events of a database file one at a time */
+typedef struct DbReader {
+    FILE *f;
+    unsigned version;
+    uint64_t next_id;
+    uint64_t generation; //incremented by each save
+    unsigned line_no;
+    char *line;
+    size_t size;
+    bool pending; //line holds an event not yet returned
+} DbReader;
+
+/* Selects and changes events for database_update_where */
+typedef bool (*event_match_fn)(Event e, void *data);
+typedef void (*event_change_fn)(Event *e, void *data);
+
 void database_init(Database *db);
 void database_destroy(Database *db);
 
@@ -16,11 +86,45 @@ void database_destroy(Database *db);
 int database_load(Database *db, FILE *f);
 int database_save(Database *db, FILE *f);
 
+void database_snapshot(Database *db, DbSnapshot *snap);
+int  database_save_snapshot(const DbSnapshot *snap, FILE *f);
+void database_release(Database *db, DbSnapshot *snap, bool saved);
+
+void database_reader_init(DbReader *r, FILE *f);
+void database_reader_destroy(DbReader *r);
+int  database_reader_header(DbReader *r);
+int  database_reader_next(DbReader *r, Event *e);
+
 bool database_is_modified(Database *db);
+bool database_is_dirty(Database *db, uint64_t id, uint64_t *base);
+void database_mark_clean(Database *db, uint64_t id);
 
-void database_add_event(Database *db, Event e);
-int  database_remove_event(Database *db, Event e);
+uint64_t database_add_event(Database *db, Event e);
+void     database_bulk_begin(Database *db);
+uint64_t database_bulk_add(Database *db, Event e);
+void     database_bulk_end(Database *db);
+int    database_remove_event(Database *db, Event e);
+int    database_update_event(Database *db, Event e);
+size_t database_update_where(Database *db, event_match_fn match, event_change_fn change, void *data);
+Event *database_get_event(Database *db, uint64_t id);
+size_t database_dedup(Database *db);
+size_t database_merge(Database *db, Database *other);
+size_t database_count(Database *db);
 
 int database_query_date(Database *db, Date d, Event **events, size_t *size);
 int database_query_date_and_time(Database *db, Date d, Time t, Event **events, size_t *size);
+int database_query_range(Database *db, Date from, Date to, Event **events, size_t *size);
+int database_query_all(Database *db, Event **events, size_t *size);
+int database_query_agenda(Database *db, Date from, Priority min, size_t n,
+                          Event **events, size_t *size);
 int database_query_tag(Database *db, const char *tag, Event **events, size_t *size);
+int database_query_tags(Database *db,
+                        const char *all[], size_t nall,
+                        const char *none[], size_t nnone,
+                        Event **events, size_t *size);
+
+void   database_day_counts(Database *db, Date from, size_t ndays, DayCount *counts);
+size_t database_count_range(Database *db, Date from, Date to);
+int    database_query_overlaps(Database *db, int64_t start, int64_t end, uint64_t skip,
+                               Event **events, size_t *size);
+int    database_free_slots(Database *db, Date d, unsigned min, Interval **slots, size_t *n);
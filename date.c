@@ -1,5 +1,6 @@
 #include "date.h"
 
+#include <ctype.h>
 #include <stdbool.h>
 
 #include "common.h"
@@ -45,24 +46,98 @@ void time_fprint(Time t, FILE *f)
     fprintf(f, "%u:%02u %s\n", (t.hour + 11) % 12 + 1, t.minute, t.hour < 11 ? "AM" : "PM");
 }
 
+/* Reads a number of one up to max digits. Returns the character after
+ * it, or NULL if there are no digits. */
+static const char *read_num(const char *s, unsigned max, unsigned *v)
+{
+    unsigned n = 0, d;
+    *v = 0;
+    for (; n < max && (d = (unsigned char)s[n] - '0') <= 9; n++)
+        *v = *v * 10 + d;
+    return n ? s + n : NULL;
+}
+
+static bool at_end(const char *s)
+{
+    return !*s || isspace((unsigned char)*s);
+}
+
+/* Writes the two digits of n < 100 */
+static char *put_2(char *s, unsigned n)
+{
+    s[0] = '0' + n / 10;
+    s[1] = '0' + n % 10;
+    return s + 2;
+}
+
+/* Parses HH:MM or H:MM, followed by the end of the string or whitespace.
+ * Gives NULL_TIME unless well formed and valid. */
 Time time_from_str(char *str)
 {
-    Time t = {0};
-    if (sscanf(str, "%u:%u", &t.hour, &t.minute) == 2)
-        return t;
-    else
+    Time t;
+    const char *s = read_num(str, 2, &t.hour);
+    if (!s || *s != ':')
+        return NULL_TIME;
+    const char *end = read_num(s + 1, 2, &t.minute);
+    if (end != s + 3 || !at_end(end) || !time_validate(t))
         return NULL_TIME;
+    return t;
+}
+
+/* Writes t as HH:MM into buf, which holds TIME_STR_LEN characters */
+void time_format(Time t, char *buf)
+{
+    buf = put_2(buf, t.hour % 100);
+    *buf++ = ':';
+    buf = put_2(buf, t.minute % 100);
+    *buf = '\0';
 }
 
 char *time_to_str(Time t)
 {
     if (!time_validate(t))
         return str_dup("Invalid time!");
-    else {
-        char *ret = malloc(6);
-        sprintf(ret, "%02u:%02u", t.hour, t.minute);
-        return ret;
+    char *ret = malloc(TIME_STR_LEN);
+    if (!ret)
+        FATAL("Failed to allocate time string!");
+    time_format(t, ret);
+    return ret;
+}
+
+/* Parses a number of minutes given as M, Mm, Hh, HhM or HhMm, followed
+ * by the end of the string or whitespace. Returns -1 unless well formed
+ * and between one minute and DURATION_MAX. */
+int duration_from_str(const char *str)
+{
+    unsigned hours = 0, minutes = 0;
+    const char *s = read_num(str, 5, &minutes);
+    if (s && *s == 'h') {
+        hours = minutes;
+        minutes = 0;
+        s++;
+        if (!at_end(s) && !(s = read_num(s, 2, &minutes)))
+            return -1;
     }
+    if (s && *s == 'm')
+        s++;
+    if (!s || !at_end(s))
+        return -1;
+
+    unsigned total = hours * 60 + minutes;
+    return total && total <= DURATION_MAX ? (int)total : -1;
+}
+
+/* Writes minutes as Hh, Mm or HhMm into buf, which holds
+ * DURATION_STR_LEN characters */
+void duration_format(unsigned minutes, char *buf)
+{
+    minutes = MIN(minutes, DURATION_MAX);
+    if (minutes >= 60 && minutes % 60)
+        sprintf(buf, "%uh%um", minutes / 60, minutes % 60);
+    else if (minutes >= 60)
+        sprintf(buf, "%uh", minutes / 60);
+    else
+        sprintf(buf, "%um", minutes);
 }
 
 Time time_add_minutes(Time t, unsigned minutes)
@@ -119,24 +194,42 @@ void date_fprint(Date d, FILE *f)
             d.year);
 }
 
+/* Parses MM/DD/YYYY, also with one digit months and days, followed by
+ * the end of the string or whitespace. Gives NULL_DATE unless well
+ * formed and valid. */
 Date date_from_str(char *str)
 {
-    Date d = {0};
-    if (sscanf(str, "%u/%u/%u", &d.month, &d.day, &d.year) == 3)
-        return d;
-    else
+    Date d;
+    const char *s = read_num(str, 2, &d.month);
+    if (!s || *s != '/' || !(s = read_num(s + 1, 2, &d.day)) || *s != '/')
         return NULL_DATE;
+    const char *end = read_num(s + 1, 4, &d.year);
+    if (end != s + 5 || !at_end(end) || !date_validate(d))
+        return NULL_DATE;
+    return d;
+}
+
+/* Writes d as MM/DD/YYYY into buf, which holds DATE_STR_LEN characters */
+void date_format(Date d, char *buf)
+{
+    buf = put_2(buf, d.month % 100);
+    *buf++ = '/';
+    buf = put_2(buf, d.day % 100);
+    *buf++ = '/';
+    buf = put_2(buf, d.year / 100 % 100);
+    buf = put_2(buf, d.year % 100);
+    *buf = '\0';
 }
 
 char *date_to_str(Date d)
 {
     if (!date_validate(d))
         return str_dup("Invalid date!");
-    else {
-        char *ret = malloc(d.month % 10 + d.day % 10 + d.year % 10 + 3);
-        sprintf(ret, "%02u/%02u/%04u", d.month, d.day, d.year);
-        return ret;
-    }
+    char *ret = malloc(DATE_STR_LEN);
+    if (!ret)
+        FATAL("Failed to allocate date string!");
+    date_format(d, ret);
+    return ret;
 }
 
 static bool leapday(unsigned y)
@@ -213,3 +306,39 @@ unsigned date_day_of_week(Date date)
     y -= m < 3;
     return (y + y/4 - y/100 + y/400 + t[m-1] + d) % 7;
 }
+
+//days since 01/01/1970, from Howard Hinnant's civil calendar algorithms
+long date_to_days(Date d)
+{
+    long y = (long)d.year - (d.month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = y - era * 400;
+    unsigned doy = (153 * (d.month > 2 ? d.month - 3 : d.month + 9) + 2) / 5 + d.day - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long)doe - 719468;
+}
+
+Date date_from_days(long days)
+{
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned doe = days - era * 146097;
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long y = yoe + era * 400;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    return (Date){y + (m <= 2), m, d};
+}
+
+const char *date_day_name(unsigned dow)
+{
+    return DAY_NAME[dow % 7];
+}
+
+/* Takes months from 1 */
+const char *date_month_name(unsigned month)
+{
+    return MONTH_NAME[(month + 11) % 12];
+}
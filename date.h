@@ -15,6 +15,13 @@ typedef struct Time {
     unsigned minute;
 } Time;
 
+#define TIME_STR_LEN 6  //HH:MM and terminator
+#define DATE_STR_LEN 11 //MM/DD/YYYY and terminator
+#define DURATION_STR_LEN 8 //up to 168h59m and terminator
+
+#define DAY_MINUTES 1440
+#define DURATION_MAX (7 * DAY_MINUTES) //longest an event can last
+
 static Date NULL_DATE = {-1, -1, -1};
 static Time NULL_TIME = {-1, -1};
 
@@ -22,22 +29,31 @@ void  time_print(Time t);
 void  time_fprint(Time t, FILE *f);
 Time  time_from_str(char *str);
 char *time_to_str(Time t);
+void  time_format(Time t, char *buf);
 Time  time_add_minutes(Time t, unsigned minutes);
 Time  time_add_hours(Time t, unsigned hours);
 int   time_compare(Time t1, Time t2);
 bool  time_validate(Time t);
 bool  time_is_null(Time t);
 
+int  duration_from_str(const char *str);
+void duration_format(unsigned minutes, char *buf);
+
 void     date_print(Date d);
 void     date_fprint(Date d, FILE *f);
 Date     date_from_str(char *str);
 char    *date_to_str(Date d);
+void     date_format(Date d, char *buf);
 Date     date_add_days(Date d, unsigned days);
 Date     date_sub_days(Date d, unsigned days);
 int      date_compare(Date d1, Date d2);
 bool     date_validate(Date d);
 bool     date_is_null(Date d);
 unsigned date_day_of_week(Date d);
+long     date_to_days(Date d);
+Date     date_from_days(long days);
+const char *date_day_name(unsigned dow);
+const char *date_month_name(unsigned month);
 
 static int str2dayofweek(char *str)
 {
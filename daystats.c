@@ -0,0 +1,122 @@
+#include "daystats.h"
+
+#include "common.h"
+
+#define DAYSTATS_MIN_DAYS 366
+
+void daystats_init(DayStats *s)
+{
+    s->first = 0;
+    s->ndays = 0;
+    s->days = NULL;
+    s->tree = NULL;
+}
+
+void daystats_destroy(DayStats *s)
+{
+    free(s->days);
+    free(s->tree);
+    daystats_init(s);
+}
+
+static void tree_add(DayStats *s, size_t i, long delta)
+{
+    for (i++; i <= s->ndays; i += i & -i)
+        s->tree[i] += delta;
+}
+
+/* Returns the number of events on the first n days */
+static size_t tree_sum(const DayStats *s, size_t n)
+{
+    size_t sum = 0;
+    for (; n; n -= n & -n)
+        sum += s->tree[n];
+    return sum;
+}
+
+/* Widens the span to take in day, at least doubling it so a run of
+ * days further out costs amortized constant time each */
+static void grow(DayStats *s, long day)
+{
+    long first = s->ndays ? MIN(s->first, day) : day;
+    long last = s->ndays ? MAX(s->first + (long)s->ndays - 1, day) : day;
+    size_t n = MAX((size_t)(last - first + 1), MAX(2 * s->ndays, DAYSTATS_MIN_DAYS));
+    if (s->ndays && day < s->first)
+        first = last - n + 1;
+
+    DayCount *days = calloc(n, sizeof(days[0]));
+    size_t *tree = calloc(n + 1, sizeof(tree[0]));
+    if (!days || !tree)
+        FATAL("Failed to allocate day counts!");
+    if (s->ndays)
+        memcpy(days + (s->first - first), s->days, s->ndays * sizeof(days[0]));
+
+    //build the tree in linear time by passing each node's sum to its parent
+    for (size_t i = 1; i <= n; i++) {
+        tree[i] += days[i - 1].events;
+        size_t parent = i + (i & -i);
+        if (parent <= n)
+            tree[parent] += tree[i];
+    }
+
+    free(s->days);
+    free(s->tree);
+    s->first = first;
+    s->ndays = n;
+    s->days = days;
+    s->tree = tree;
+}
+
+void daystats_add(DayStats *s, Date d, Priority p)
+{
+    long day = date_to_days(d);
+    if (!s->ndays || day < s->first || day >= s->first + (long)s->ndays)
+        grow(s, day);
+
+    size_t i = day - s->first;
+    s->days[i].events++;
+    if (priority_validate(p))
+        s->days[i].priorities[p]++;
+    tree_add(s, i, 1);
+}
+
+void daystats_remove(DayStats *s, Date d, Priority p)
+{
+    long day = date_to_days(d);
+    if (!s->ndays || day < s->first || day >= s->first + (long)s->ndays)
+        return;
+
+    size_t i = day - s->first;
+    s->days[i].events--;
+    if (priority_validate(p))
+        s->days[i].priorities[p]--;
+    tree_add(s, i, -1);
+}
+
+DayCount daystats_get(const DayStats *s, long day)
+{
+    if (!s->ndays || day < s->first || day >= s->first + (long)s->ndays)
+        return (DayCount){0};
+    return s->days[day - s->first];
+}
+
+/* Returns the number of events from day from to day to inclusive, from
+ * two prefix sums */
+size_t daystats_count(const DayStats *s, long from, long to)
+{
+    long end = s->first + (long)s->ndays;
+    from = MAX(from, s->first);
+    to = MIN(to + 1, end);
+    if (from >= to)
+        return 0;
+    return tree_sum(s, to - s->first) - tree_sum(s, from - s->first);
+}
+
+Priority daycount_max_priority(DayCount c)
+{
+    for (int p = URGENT; p >= LOW; p--) {
+        if (c.priorities[p])
+            return p;
+    }
+    return -1;
+}
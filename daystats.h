@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "event.h"
+
+typedef struct DayCount {
+    unsigned events;
+    unsigned priorities[URGENT + 1]; //events of each priority
+} DayCount;
+
+/* Event counts of each day over a span of days that grows to fit, with
+ * a Fenwick tree over them for the number of events in any range */
+typedef struct DayStats {
+    long first;    //day number, as of date_to_days, of days[0]
+    size_t ndays;
+    DayCount *days;
+    size_t *tree;  //1-based Fenwick tree of days[].events
+} DayStats;
+
+void     daystats_init(DayStats *s);
+void     daystats_destroy(DayStats *s);
+void     daystats_add(DayStats *s, Date d, Priority p);
+void     daystats_remove(DayStats *s, Date d, Priority p);
+DayCount daystats_get(const DayStats *s, long day);
+size_t   daystats_count(const DayStats *s, long from, long to);
+Priority daycount_max_priority(DayCount c);
@@ -0,0 +1,410 @@
+#include "diff.h"
+
+#include "common.h"
+#include "idmap.h"
+
+/* Events of a source sharing one date and time, along with the event
+ * read after them */
+typedef struct Stream {
+    DiffSource src;
+    int state; //result of the last call to src.next
+    Event ahead;
+    Event *run;
+    bool *matched;
+    size_t count;
+    size_t cap;
+    IdMap ids;     //position in run of each event by id
+    size_t idless; //events in run without an id, as in files before v3
+} Stream;
+
+static int next_file(void *data, Event *e)
+{
+    return database_reader_next(data, e);
+}
+
+DiffSource diff_source_file(DbReader *r)
+{
+    return (DiffSource){next_file, r, true};
+}
+
+static int next_database(void *data, Event *e)
+{
+    Event *stored = store_next(data);
+    if (!stored)
+        return 0;
+    *e = *stored;
+    return 1;
+}
+
+/* Reads the events of a database from it onwards */
+DiffSource diff_source_database(StoreIter *it)
+{
+    return (DiffSource){next_database, it, false};
+}
+
+static void release_run(Stream *s)
+{
+    for (size_t i = 0; i < s->count; i++) {
+        idmap_remove(&s->ids, s->run[i].id);
+        if (s->src.owned)
+            event_destroy(&s->run[i]);
+    }
+    s->count = 0;
+    s->idless = 0;
+}
+
+/* Replaces the run of s with the next one. Returns 1 on success, 0 at
+ * the end of the source and -1 on error. */
+static int read_run(Stream *s)
+{
+    release_run(s);
+    if (s->state != 1)
+        return s->state;
+
+    Event first = s->ahead;
+    do {
+        if (s->count == s->cap) {
+            s->cap = s->cap ? s->cap * 2 : 8;
+            s->run = realloc(s->run, s->cap * sizeof(s->run[0]));
+            s->matched = realloc(s->matched, s->cap * sizeof(s->matched[0]));
+            if (!s->run || !s->matched)
+                FATAL("Failed to allocate diff buffer!");
+        }
+        s->matched[s->count] = false;
+        if (s->ahead.id)
+            idmap_set(&s->ids, s->ahead.id, s->count);
+        else
+            s->idless++;
+        s->run[s->count++] = s->ahead;
+        s->state = s->src.next(s->src.data, &s->ahead);
+    } while (s->state == 1 && !event_sort_time(s->ahead, first));
+
+    if (s->state == 1 && event_sort_time(s->ahead, first) < 0) {
+        fprintf(stderr, "Events are not in sorted order!\n");
+        return -1;
+    }
+    return s->state == -1 ? -1 : 1;
+}
+
+/* Whether two events at the same date and time are versions of each
+ * other, by id when both have one and by subject otherwise */
+static bool same_event(Event a, Event b)
+{
+    if (a.id && b.id)
+        return a.id == b.id;
+    return a.subject && b.subject && !strcmp(a.subject, b.subject);
+}
+
+/* Returns the first event of b after j which the pairwise scan may pair
+ * with e, from the start for j = -1. The scan pairs events only where
+ * one of them has no id. Returns b->count if there is none. */
+static size_t next_unpaired(Stream *b, size_t j, Event e)
+{
+    for (j++; j < b->count; j++) {
+        if (!b->matched[j] && (!e.id || !b->run[j].id))
+            break;
+    }
+    return j;
+}
+
+static void diff_runs(Stream *a, Stream *b, diff_report_fn report, void *data)
+{
+    //events with an id are paired by it, in time linear in the runs
+    for (size_t i = 0; i < a->count; i++) {
+        size_t j;
+        if (!idmap_get(&b->ids, a->run[i].id, &j) || b->matched[j])
+            continue;
+        a->matched[i] = b->matched[j] = true;
+        if (!event_equal(a->run[i], b->run[j]))
+            report(data, DIFF_CHANGED, &a->run[i], &b->run[j]);
+    }
+
+    //the rest are compared pairwise, skipping events of a with an id
+    //when every event of b has one
+    for (size_t i = 0; i < a->count; i++) {
+        if (a->matched[i] || (a->run[i].id && !b->idless))
+            continue;
+        for (size_t j = next_unpaired(b, -1, a->run[i]); j < b->count;
+             j = next_unpaired(b, j, a->run[i])) {
+            if (event_equal(a->run[i], b->run[j])) {
+                a->matched[i] = b->matched[j] = true;
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < a->count; i++) {
+        if (a->matched[i] || (a->run[i].id && !b->idless))
+            continue;
+        for (size_t j = next_unpaired(b, -1, a->run[i]); j < b->count;
+             j = next_unpaired(b, j, a->run[i])) {
+            if (same_event(a->run[i], b->run[j])) {
+                a->matched[i] = b->matched[j] = true;
+                report(data, DIFF_CHANGED, &a->run[i], &b->run[j]);
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < a->count; i++) {
+        if (!a->matched[i])
+            report(data, DIFF_REMOVED, &a->run[i], NULL);
+    }
+    for (size_t j = 0; j < b->count; j++) {
+        if (!b->matched[j])
+            report(data, DIFF_ADDED, NULL, &b->run[j]);
+    }
+}
+
+static void stream_destroy(Stream *s)
+{
+    release_run(s);
+    if (s->state == 1 && s->src.owned)
+        event_destroy(&s->ahead);
+    free(s->run);
+    free(s->matched);
+    idmap_destroy(&s->ids);
+}
+
+/* Reports the differences between two sorted sequences of events in a
+ * single pass. Only the events at one date and time are held at once,
+ * though that is a whole import made on one date without times. Events
+ * are paired within such a run by id, so the cost is linear but for
+ * events without one, from files before version 3, which are compared
+ * pairwise in time quadratic in the run. */
+int diff_events(DiffSource a, DiffSource b, diff_report_fn report, void *data)
+{
+    Stream sa = {a}, sb = {b};
+    sa.state = a.next(a.data, &sa.ahead);
+    sb.state = b.next(b.data, &sb.ahead);
+
+    int ka = read_run(&sa);
+    int kb = read_run(&sb);
+    while (ka == 1 || kb == 1) {
+        if (ka == -1 || kb == -1)
+            break;
+
+        int cmp = !ka ? 1 : !kb ? -1 : event_sort_time(sa.run[0], sb.run[0]);
+        if (cmp < 0) {
+            for (size_t i = 0; i < sa.count; i++)
+                report(data, DIFF_REMOVED, &sa.run[i], NULL);
+            ka = read_run(&sa);
+        } else if (cmp > 0) {
+            for (size_t j = 0; j < sb.count; j++)
+                report(data, DIFF_ADDED, NULL, &sb.run[j]);
+            kb = read_run(&sb);
+        } else {
+            diff_runs(&sa, &sb, report, data);
+            ka = read_run(&sa);
+            kb = read_run(&sb);
+        }
+    }
+
+    stream_destroy(&sa);
+    stream_destroy(&sb);
+    return ka == -1 || kb == -1 ? -1 : 0;
+}
+
+/* A change read from the file, to be applied once diffing is done */
+typedef struct Change {
+    DiffKind kind;
+    uint64_t id; //of the event in the database
+    Event e;     //new version, unless removed
+} Change;
+
+typedef struct Reload {
+    Database *db;
+    Change *changes;
+    size_t count;
+    IdMap seen;    //ids of events changed here which are in the file
+    IdMap missing; //ids of events changed here which are not where expected
+    diff_report_fn conflict;
+    void *data;
+} Reload;
+
+static void add_change(Reload *r, DiffKind kind, uint64_t id, Event *new)
+{
+    Change c = {kind, id};
+    if (new)
+        event_clone(&c.e, *new);
+    r->changes = add_element(r->changes, &r->count, sizeof(c), r->count, &c);
+}
+
+static void collect_change(void *data, DiffKind kind, Event *old, Event *new)
+{
+    Reload *r = data;
+    uint64_t id = old ? old->id : new->id;
+    uint64_t base;
+
+    if (!database_is_dirty(r->db, id, &base)) {
+        add_change(r, kind, id, new);
+        return;
+    }
+
+    //changed here as well, so only a conflict if the file changed it.
+    //the file may still have it at another date, so wait to decide
+    if (!new) {
+        idmap_set(&r->missing, id, 0);
+        return;
+    }
+    idmap_set(&r->seen, id, 0);
+    if (new->hash == base)
+        return;
+    if (kind == DIFF_ADDED && !base) {
+        //both added an event with this id, it is reassigned when applied
+        add_change(r, kind, id, new);
+        return;
+    }
+    r->conflict(r->data, kind, old, new);
+}
+
+static void apply_change(Database *db, Change *c)
+{
+    switch (c->kind) {
+    case DIFF_ADDED :
+        c->e.id = c->id;
+        c->id = database_add_event(db, c->e);
+        break;
+    case DIFF_REMOVED :
+        database_remove_event(db, *database_get_event(db, c->id));
+        break;
+    case DIFF_CHANGED :
+        c->e.id = c->id;
+        database_update_event(db, c->e);
+        break;
+    }
+    database_mark_clean(db, c->id);
+}
+
+/* Brings db up to date with the events read by r, applying only what
+ * differs. Changes to events which were also changed in db since it was
+ * last loaded or saved are passed to conflict instead. Returns the
+ * number of changes applied, or -1 on error, in which case none are. */
+int diff_apply(Database *db, DbReader *r, diff_report_fn conflict, void *data)
+{
+    StoreIter it = store_iter(db->events, 0);
+    Reload rl = {db, NULL, 0};
+    rl.conflict = conflict;
+    rl.data = data;
+    idmap_init(&rl.seen);
+    idmap_init(&rl.missing);
+    int err = diff_events(diff_source_database(&it), diff_source_file(r), collect_change, &rl);
+
+    //events changed here and gone from the file were removed by both, or
+    //were added here if they had no fingerprint to begin with
+    for (size_t i = 0; err != -1 && i < rl.missing.cap; i++) {
+        uint64_t id = rl.missing.keys[i];
+        uint64_t base;
+        size_t unused;
+        if (id && !idmap_get(&rl.seen, id, &unused) &&
+            database_is_dirty(db, id, &base) && base)
+            conflict(data, DIFF_REMOVED, database_get_event(db, id), NULL);
+    }
+    idmap_destroy(&rl.seen);
+    idmap_destroy(&rl.missing);
+
+    //removals first, so events moved to another date keep their id
+    for (size_t i = 0; i < rl.count; i++) {
+        if (err != -1 && rl.changes[i].kind == DIFF_REMOVED)
+            apply_change(db, &rl.changes[i]);
+    }
+    for (size_t i = 0; i < rl.count; i++) {
+        if (rl.changes[i].kind == DIFF_REMOVED)
+            continue;
+        if (err != -1)
+            apply_change(db, &rl.changes[i]);
+        else
+            event_destroy(&rl.changes[i].e);
+    }
+    free(rl.changes);
+
+    if (err == -1)
+        return -1;
+    db->next_id = MAX(db->next_id, r->next_id);
+    db->generation = r->generation;
+    return rl.count;
+}
+
+static char *tags_to_str(Event e) //allocates new string
+{
+    size_t len = 1;
+    for (size_t i = 0; i < e.ntags; i++)
+        len += strlen(e.tags[i]) + 2;
+
+    char *ret = malloc(len);
+    ret[0] = '\0';
+    for (size_t i = 0; i < e.ntags; i++) {
+        if (i)
+            strcat(ret, ", ");
+        strcat(ret, e.tags[i]);
+    }
+    return ret;
+}
+
+static void print_summary(Event e)
+{
+    char *date = date_to_str(e.date);
+    printf("%s", date);
+    free(date);
+    if (!time_is_null(e.time)) {
+        char *time = time_to_str(e.time);
+        printf(" %s", time);
+        free(time);
+    }
+    printf(" %s", e.subject ? e.subject : "");
+    if (e.id)
+        printf(" (#%" PRIu64 ")", e.id);
+    printf("\n");
+}
+
+static void print_field(const char *name, const char *old, const char *new)
+{
+    old = old ? old : "";
+    new = new ? new : "";
+    if (strcmp(old, new))
+        printf("    %s: %s -> %s\n", name, old, new);
+}
+
+/* Prints a difference as a line starting with +, - or ~, followed by
+ * the fields which changed */
+void diff_print(DiffKind kind, Event *old, Event *new)
+{
+    switch (kind) {
+    case DIFF_ADDED :
+        PRTESC(GRN);
+        printf("+ ");
+        print_summary(*new);
+        PRTESC(RESET);
+        return;
+    case DIFF_REMOVED :
+        PRTESC(RED);
+        printf("- ");
+        print_summary(*old);
+        PRTESC(RESET);
+        return;
+    case DIFF_CHANGED :
+        PRTESC(YEL);
+        printf("~ ");
+        print_summary(*new);
+        PRTESC(RESET);
+        break;
+    }
+
+    const char *old_prty = priority_validate(old->priority) ? priority_to_str(old->priority) : NULL;
+    const char *new_prty = priority_validate(new->priority) ? priority_to_str(new->priority) : NULL;
+    print_field("priority", old_prty, new_prty);
+    print_field("subject", old->subject, new->subject);
+    print_field("location", old->location, new->location);
+    print_field("details", old->details, new->details);
+
+    char *old_str = recur_to_str(old->recur);
+    char *new_str = recur_to_str(new->recur);
+    print_field("repeats", old_str, new_str);
+    free(old_str);
+    free(new_str);
+
+    old_str = tags_to_str(*old);
+    new_str = tags_to_str(*new);
+    print_field("tags", old_str, new_str);
+    free(old_str);
+    free(new_str);
+}
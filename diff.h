@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "database.h"
+#include "event.h"
+
+typedef enum DiffKind {
+    DIFF_ADDED,
+    DIFF_REMOVED,
+    DIFF_CHANGED
+} DiffKind;
+
+/* A sequence of events in sorted order. next stores the following event
+ * in *e and returns 1, or returns 0 at the end and -1 on error. */
+typedef struct DiffSource {
+    int (*next)(void *data, Event *e);
+    void *data;
+    bool owned; //whether produced events should be destroyed after use
+} DiffSource;
+
+/* Called for each difference. old is NULL for added events and new is
+ * NULL for removed ones. */
+typedef void (*diff_report_fn)(void *data, DiffKind kind, Event *old, Event *new);
+
+DiffSource diff_source_file(DbReader *r);
+DiffSource diff_source_database(StoreIter *it);
+
+int  diff_events(DiffSource a, DiffSource b, diff_report_fn report, void *data);
+int  diff_apply(Database *db, DbReader *r, diff_report_fn conflict, void *data);
+void diff_print(DiffKind kind, Event *old, Event *new);
@@ -2,8 +2,6 @@
 
 #include "common.h"
 
-int TERM_COLOR;
-
 static const char *PRIORITY_TEXT[] = {
     "Low",
     "Medium",
@@ -11,17 +9,68 @@ static const char *PRIORITY_TEXT[] = {
     "Urgent"
 };
 
+/* The fingerprint is the xor of a hash of each field, seeded by which
+ * field it is, so a setter only needs to rehash the field it changes */
+enum {
+    HASH_DATE = 1,
+    HASH_TIME,
+    HASH_PRTY,
+    HASH_SUBJ,
+    HASH_LCTN,
+    HASH_DTLS,
+    HASH_RECR,
+    HASH_TAG,
+    HASH_DRTN
+};
+
+#define HASH_FIELD(x, field) hash_bytes(&(x), sizeof(x), field)
+
+static uint64_t hash_str(const char *s, uint64_t field)
+{
+    return s ? hash_bytes(s, strlen(s), field) : 0;
+}
+
+static uint64_t hash_tags(Event e)
+{
+    uint64_t h = 0;
+    for (unsigned i = 0; i < e.ntags; i++)
+        h ^= hash_str(e.tags[i], HASH_TAG);
+    return h;
+}
+
+static uint64_t hash_event(Event e)
+{
+    return HASH_FIELD(e.date, HASH_DATE)
+        ^ HASH_FIELD(e.time, HASH_TIME)
+        ^ HASH_FIELD(e.priority, HASH_PRTY)
+        ^ hash_str(e.subject, HASH_SUBJ)
+        ^ hash_str(e.location, HASH_LCTN)
+        ^ hash_str(e.details, HASH_DTLS)
+        ^ HASH_FIELD(e.recur, HASH_RECR)
+        ^ HASH_FIELD(e.duration, HASH_DRTN)
+        ^ hash_tags(e);
+}
+
 static int strcmp_wrapper(const void *a, const void *b)
 {
     return strcmp(*((char **)a), *((char **)b));
 }
 
+static void mask_tag(Event *e, const char *tag)
+{
+    int bit = tag_intern(tag);
+    if (bit != -1)
+        tagmask_set(&e->tagmask, bit);
+}
+
 static void cpy_tags(Event *e, const char *tags[], size_t ntags)
 {
     e->ntags = ntags;
     e->tags = malloc(e->ntags * sizeof(e->tags[0]));
+    tagmask_clear(&e->tagmask);
     for (unsigned i = 0; i < e->ntags; i++) {
         e->tags[i] = str_dup(tags[i]);
+        mask_tag(e, tags[i]);
     }
     qsort(e->tags, e->ntags, sizeof(e->tags[0]), strcmp_wrapper);
 }
@@ -34,6 +83,7 @@ static void free_tags(Event *e)
         free(e->tags);
         e->ntags = 0;
     }
+    tagmask_clear(&e->tagmask);
 }
 
 void event_init(Event *e,
@@ -45,14 +95,18 @@ void event_init(Event *e,
                 const char *tags[],
                 size_t ntags)
 {
+    e->id = 0;
     e->date = d;
     e->time = t;
+    e->duration = 0;
     e->priority = priority_validate(p) ? p : -1;
     e->subject = NULL;
     e->location = NULL;
     e->details = NULL;
     e->tags = NULL;
     e->ntags = 0;
+    e->recur = NULL_RECUR;
+    tagmask_clear(&e->tagmask);
 
     if (sub && *sub)
         e->subject = str_dup(sub);
@@ -62,6 +116,7 @@ void event_init(Event *e,
         e->details = str_dup(det);
     if (tags && ntags > 0)
         cpy_tags(e, tags, ntags);
+    e->hash = hash_event(*e);
 }
 
 void event_clone(Event *dest, Event src)
@@ -85,12 +140,12 @@ void event_destroy(Event *e)
     e->tags = NULL;
 }
 
-void event_print(Event e, uint8_t flags)
+void event_print(Event e, uint16_t flags)
 {
     event_fprint(e, stdout, flags);
 }
 
-void event_fprint(Event e, FILE *f, uint8_t flags)
+void event_fprint(Event e, FILE *f, uint16_t flags)
 {
     if (flags & PRINT_DATE && date_validate(e.date)) {
         fprintf(f, "\n");
@@ -102,12 +157,25 @@ void event_fprint(Event e, FILE *f, uint8_t flags)
         fprintf(f, "\n");
     }
 
+    if (flags & PRINT_ID && e.id) {
+        if (TERM_COLOR)
+            printf(CYN);
+        fprintf(f, "#%" PRIu64 "\n", e.id);
+        if (TERM_COLOR)
+            printf(RESET);
+    }
+
     if (flags & PRINT_TIME && time_validate(e.time)) {
         if (TERM_COLOR)
             printf(BOLD MAG);
         time_fprint(e.time, f);
         if (TERM_COLOR)
             printf(RESET);
+        if (e.duration) {
+            char buf[DURATION_STR_LEN];
+            duration_format(e.duration, buf);
+            fprintf(f, "For %s\n", buf);
+        }
     }
 
     if (flags & PRINT_SUBJ && e.subject) {
@@ -165,6 +233,16 @@ void event_fprint(Event e, FILE *f, uint8_t flags)
         fprintf(f, "\n");
     }
 
+    if (flags & PRINT_RECR && !recur_is_null(e.recur)) {
+        if (TERM_COLOR)
+            printf(CYN);
+        fprintf(f, "Repeats:\n");
+        if (TERM_COLOR)
+            printf(RESET);
+        recur_fprint(e.recur, f);
+        fprintf(f, "\n");
+    }
+
     if (flags & PRINT_TAGS && e.tags && e.ntags > 0) {
         if (TERM_COLOR)
             printf(CYN);
@@ -179,18 +257,18 @@ void event_fprint(Event e, FILE *f, uint8_t flags)
     fprintf(f, "\n");
 }
 
-void event_print_arr(Event *e, size_t n, uint8_t flags)
+void event_print_arr(Event *e, size_t n, uint16_t flags)
 {
     event_fprint_arr(e, n, stdout, flags);
 }
 
-void event_fprint_arr(Event *e, size_t n, FILE *f, uint8_t flags)
+void event_fprint_arr(Event *e, size_t n, FILE *f, uint16_t flags)
 {
     if (n > 0)
         fprintf(f, "\n");
     Date last_date = {0};
     for (unsigned i = 0; i < n; i++) {
-        uint8_t pflgs = flags;
+        uint16_t pflgs = flags;
         if (!date_compare(e[i].date, last_date))
             pflgs &= ~PRINT_DATE;
         else
@@ -199,27 +277,102 @@ void event_fprint_arr(Event *e, size_t n, FILE *f, uint8_t flags)
     }
 }
 
+static unsigned text_lines(const char *str, unsigned width)
+{
+    unsigned lines = 0;
+    unsigned len = 0;
+    for (;; str++) {
+        if (!*str || *str == '\n') {
+            lines += width && len > width ? (len + width - 1) / width : 1;
+            len = 0;
+            if (!*str)
+                break;
+        } else {
+            len++;
+        }
+    }
+    return lines;
+}
+
+unsigned event_fprint_lines(Event e, uint16_t flags, unsigned width)
+{
+    unsigned lines = 1;
+
+    if (flags & PRINT_DATE && date_validate(e.date))
+        lines += 3;
+    if (flags & PRINT_ID && e.id)
+        lines += 1;
+    if (flags & PRINT_TIME && time_validate(e.time))
+        lines += 1 + !!e.duration;
+    if (flags & PRINT_SUBJ && e.subject)
+        lines += text_lines(e.subject, width) + 1;
+    if (flags & PRINT_PRTY && priority_validate(e.priority))
+        lines += 3;
+    if (flags & PRINT_LCTN && e.location)
+        lines += text_lines(e.location, width) + 2;
+    if (flags & PRINT_DTLS && e.details)
+        lines += text_lines(e.details, width) + 2;
+    if (flags & PRINT_RECR && !recur_is_null(e.recur))
+        lines += 3;
+    if (flags & PRINT_TAGS && e.tags && e.ntags > 0) {
+        unsigned len = 0;
+        for (unsigned i = 0; i < e.ntags; i++)
+            len += strlen(e.tags[i]) + 2;
+        lines += (width && len > width ? (len + width - 1) / width : 1) + 2;
+    }
+
+    return lines;
+}
+
+size_t event_arr_find_date(Event *e, size_t n, Date d)
+{
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (date_compare(e[mid].date, d) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
 int event_sort_time(Event e1, Event e2)
 {
     int date_cmp = date_compare(e1.date, e2.date);
     return date_cmp ? date_cmp : time_compare(e1.time, e2.time);
 }
 
+/* Packs the date and time of e into an integer ordered as event_sort_time
+ * orders events, for valid or null dates and times */
+uint64_t event_sort_key(Event e)
+{
+    uint64_t date = date_is_null(e.date) ? 0 :
+        ((uint64_t)e.date.year << 9 | e.date.month << 5 | e.date.day) + 1;
+    uint64_t time = time_is_null(e.time) ? 0 : e.time.hour * 60 + e.time.minute + 1;
+    return date << 11 | time;
+}
+
 bool event_equal(Event e1, Event e2)
 {
+    if (e1.hash != e2.hash)
+        return false;
+
     bool eq = true;
     eq &= !date_compare(e1.date, e2.date);
     eq &= !time_compare(e1.time, e2.time);
+    eq &= e1.duration == e2.duration;
     eq &= e1.priority == e2.priority;
-    eq &= e1.subject == e2.subject;
+    eq &= !e1.subject == !e2.subject;
     if (e1.subject && e2.subject)
         eq &= !strcmp(e1.subject, e2.subject);
-    eq &= e1.location == e2.location;
+    eq &= !e1.location == !e2.location;
     if (e1.location && e2.location)
         eq &= !strcmp(e1.location, e2.location);
-    eq &= e1.details == e2.details;
+    eq &= !e1.details == !e2.details;
     if (e1.details && e2.details)
         eq &= !strcmp(e1.details, e2.details);
+    eq &= recur_equal(e1.recur, e2.recur);
     eq &= e1.ntags == e2.ntags;
 
     if (!eq) {
@@ -236,65 +389,95 @@ bool event_equal(Event e1, Event e2)
 
 void event_set_date(Event *e, Date d)
 {
+    e->hash ^= HASH_FIELD(e->date, HASH_DATE);
     if (!date_validate(d))
         e->date = NULL_DATE;
     else
         e->date = d;
+    e->hash ^= HASH_FIELD(e->date, HASH_DATE);
 }
 
 void event_set_time(Event *e, Time t)
 {
+    e->hash ^= HASH_FIELD(e->time, HASH_TIME);
     if (!time_validate(t))
         e->time = NULL_TIME;
     else
         e->time = t;
+    e->hash ^= HASH_FIELD(e->time, HASH_TIME);
+}
+
+void event_set_duration(Event *e, unsigned minutes)
+{
+    e->hash ^= HASH_FIELD(e->duration, HASH_DRTN);
+    e->duration = minutes <= DURATION_MAX ? minutes : 0;
+    e->hash ^= HASH_FIELD(e->duration, HASH_DRTN);
 }
 
 void event_set_priority(Event *e, Priority p)
 {
+    e->hash ^= HASH_FIELD(e->priority, HASH_PRTY);
     e->priority = -1;
     if (priority_validate(p))
         e->priority = p;
+    e->hash ^= HASH_FIELD(e->priority, HASH_PRTY);
 }
 
 void event_set_subject(Event *e, const char *sub)
 {
+    e->hash ^= hash_str(e->subject, HASH_SUBJ);
     if (e->subject)
         free(e->subject);
     e->subject = NULL;
 
     if (sub && *sub)
         e->subject = str_dup(sub);
+    e->hash ^= hash_str(e->subject, HASH_SUBJ);
 }
 
 void event_set_location(Event *e, const char *loc)
 {
+    e->hash ^= hash_str(e->location, HASH_LCTN);
     if (e->location)
         free(e->location);
     e->location = NULL;
 
     if (loc && *loc)
         e->location = str_dup(loc);
+    e->hash ^= hash_str(e->location, HASH_LCTN);
 }
 
 void event_set_details(Event *e, const char *det)
 {
+    e->hash ^= hash_str(e->details, HASH_DTLS);
     if (e->details)
         free(e->details);
     e->details = NULL;
 
     if (det && *det)
         e->details = str_dup(det);
+    e->hash ^= hash_str(e->details, HASH_DTLS);
 }
 
 void event_set_tags(Event *e, const char *tags[], size_t ntags)
 {
-    if (e->tags && e->ntags > 0)
-        free(tags);
+    e->hash ^= hash_tags(*e);
+    free_tags(e);
     e->tags = NULL;
 
     if (tags && ntags > 0)
         cpy_tags(e, tags, ntags);
+    e->hash ^= hash_tags(*e);
+}
+
+void event_set_recurrence(Event *e, Recurrence r)
+{
+    e->hash ^= HASH_FIELD(e->recur, HASH_RECR);
+    if (!recur_validate(r))
+        e->recur = NULL_RECUR;
+    else
+        e->recur = r;
+    e->hash ^= HASH_FIELD(e->recur, HASH_RECR);
 }
 
 void event_add_tag(Event *e, const char *tag)
@@ -305,22 +488,26 @@ void event_add_tag(Event *e, const char *tag)
         if (i == e->ntags || strcmp(e->tags[i], tag)) {
             char *tag2 = str_dup(tag);
             e->tags = add_element(e->tags, &e->ntags, sizeof(e->tags[0]), i, &tag2);
+            e->hash ^= hash_str(tag, HASH_TAG);
+            mask_tag(e, tag);
         }
     }
 }
 
 static int get_tag_index(Event e, const char *tag)
 {
-    int start = 0;
-    size_t size = e.ntags;
-
-    while (size >= 1) {
-        char **offset = &e.tags[start + (size / 2)];
-        if (!strcmp(*offset, tag))
-            return start + (size / 2);
-        bool lt = strcmp(*offset, tag) > 0;
-        start = lt ? start : start + (size / 2);
-        size = lt ? size / 2 : size - ((size + 1) / 2);
+    size_t lo = 0;
+    size_t hi = e.ntags;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(e.tags[mid], tag);
+        if (!cmp)
+            return mid;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
     return -1;
@@ -330,6 +517,10 @@ void event_remove_tag(Event *e, const char *tag)
 {
     int tag_ind;
     if ((tag_ind = get_tag_index(*e, tag)) >= 0) {
+        e->hash ^= hash_str(tag, HASH_TAG);
+        int bit = tag_lookup(tag);
+        if (bit != -1)
+            tagmask_unset(&e->tagmask, bit);
         free(e->tags[tag_ind]);
         remove_element(e->tags, &e->ntags, sizeof(e->tags[0]), tag_ind);
     }
@@ -340,6 +531,22 @@ bool event_contains_tag(Event e, const char *tag)
     return get_tag_index(e, tag) != -1;
 }
 
+bool event_is_recurring(Event e)
+{
+    return !recur_is_null(e.recur);
+}
+
+/* Sets *start and *end to the minutes since 01/01/1970 the event takes
+ * up. Returns false for events without a date, time or duration. */
+bool event_span(Event e, int64_t *start, int64_t *end)
+{
+    if (date_is_null(e.date) || time_is_null(e.time) || !e.duration)
+        return false;
+    *start = (int64_t)date_to_days(e.date) * DAY_MINUTES + e.time.hour * 60 + e.time.minute;
+    *end = *start + e.duration;
+    return true;
+}
+
 Priority priority_from_str(char *str)
 {
     if (!strcmp(str, PRIORITY_TEXT[LOW]) ||
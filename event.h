@@ -4,8 +4,10 @@
 #include <inttypes.h>
 
 #include "date.h"
+#include "recur.h"
+#include "tagmask.h"
 
-#define PRINT_ALL  0xFF
+#define PRINT_ALL  0xFFFF
 #define PRINT_DATE 0x01
 #define PRINT_TIME 0x02
 #define PRINT_PRTY 0x04
@@ -13,6 +15,8 @@
 #define PRINT_LCTN 0x10
 #define PRINT_DTLS 0x20
 #define PRINT_TAGS 0x40
+#define PRINT_RECR 0x80
+#define PRINT_ID   0x100
 
 typedef enum Priority {
     LOW,
@@ -22,14 +26,19 @@ typedef enum Priority {
 } Priority;
 
 typedef struct Event {
+    uint64_t id; //0 until added to a database
     Date date;
     Time time;
+    unsigned duration; //minutes from time, 0 for none
     Priority priority;
     char *subject;
     char *location;
     char *details;
     char **tags;
     size_t ntags;
+    Recurrence recur;
+    uint64_t hash; //fingerprint of the fields above except id, kept by the setters
+    TagMask tagmask; //bits of the tags that have one, kept by the setters
 } Event;
 
 void event_init(Event *e,
@@ -43,24 +52,31 @@ void event_init(Event *e,
 void event_clone(Event *dest, Event src);
 void event_destroy(Event *e);
 
-void event_print(Event e, uint8_t flags);
-void event_fprint(Event e, FILE *f, uint8_t flags);
-void event_print_arr(Event *e, size_t n, uint8_t flags);
-void event_fprint_arr(Event *e, size_t n, FILE *f, uint8_t flags);
+void event_print(Event e, uint16_t flags);
+void event_fprint(Event e, FILE *f, uint16_t flags);
+void event_print_arr(Event *e, size_t n, uint16_t flags);
+void event_fprint_arr(Event *e, size_t n, FILE *f, uint16_t flags);
+unsigned event_fprint_lines(Event e, uint16_t flags, unsigned width);
+size_t   event_arr_find_date(Event *e, size_t n, Date d);
 
 int  event_sort_time(Event e1, Event e2);
+uint64_t event_sort_key(Event e);
 bool event_equal(Event e1, Event e2);
 
 void event_set_date(Event *e, Date d);
 void event_set_time(Event *e, Time t);
+void event_set_duration(Event *e, unsigned minutes);
 void event_set_priority(Event *e, Priority p);
 void event_set_subject(Event *e, const char *sub);
 void event_set_location(Event *e, const char *loc);
 void event_set_details(Event *e, const char *det);
 void event_set_tags(Event *e, const char *tags[], size_t ntags);
+void event_set_recurrence(Event *e, Recurrence r);
 void event_add_tag(Event *e, const char *tag);
 void event_remove_tag(Event *e, const char *tag);
 bool event_contains_tag(Event e, const char *tag);
+bool event_is_recurring(Event e);
+bool event_span(Event e, int64_t *start, int64_t *end);
 
 Priority priority_from_str(char *str);
 const char *priority_to_str(Priority p);
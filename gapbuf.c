@@ -0,0 +1,128 @@
+#include "gapbuf.h"
+
+#include "common.h"
+
+#define GAPBUF_MIN_SIZE 16
+
+/* Ensures the gap can hold at least need characters plus a terminator */
+static void reserve(GapBuf *gb, size_t need)
+{
+    if (gb->gap_end - gb->gap_start > need)
+        return;
+
+    size_t len = gapbuf_length(gb);
+    size_t size = gb->size ? gb->size : GAPBUF_MIN_SIZE;
+    while (size - len <= need)
+        size *= 2;
+
+    size_t tail = gb->size - gb->gap_end;
+    gb->buf = realloc(gb->buf, size);
+    if (!gb->buf)
+        FATAL("Failed to allocate edit buffer!");
+    memmove(gb->buf + size - tail, gb->buf + gb->gap_end, tail);
+    gb->gap_end = size - tail;
+    gb->size = size;
+}
+
+void gapbuf_init(GapBuf *gb, const char *str)
+{
+    gb->buf = NULL;
+    gb->size = 0;
+    gb->gap_start = 0;
+    gb->gap_end = 0;
+    gapbuf_set(gb, str);
+}
+
+void gapbuf_destroy(GapBuf *gb)
+{
+    free(gb->buf);
+    gb->buf = NULL;
+    gb->size = 0;
+    gb->gap_start = 0;
+    gb->gap_end = 0;
+}
+
+/* Replaces the contents with str, leaving the cursor at the start */
+void gapbuf_set(GapBuf *gb, const char *str)
+{
+    size_t len = str ? strlen(str) : 0;
+    gb->gap_start = 0;
+    gb->gap_end = gb->size;
+    reserve(gb, len);
+    gb->gap_end = gb->size - len;
+    if (len)
+        memcpy(gb->buf + gb->gap_end, str, len);
+}
+
+/* Moves the cursor to index i, clamped to the length of the text */
+void gapbuf_move(GapBuf *gb, size_t i)
+{
+    i = MIN(i, gapbuf_length(gb));
+    if (i < gb->gap_start) {
+        size_t n = gb->gap_start - i;
+        memmove(gb->buf + gb->gap_end - n, gb->buf + i, n);
+        gb->gap_start -= n;
+        gb->gap_end -= n;
+    } else if (i > gb->gap_start) {
+        size_t n = i - gb->gap_start;
+        memmove(gb->buf + gb->gap_start, gb->buf + gb->gap_end, n);
+        gb->gap_start += n;
+        gb->gap_end += n;
+    }
+}
+
+void gapbuf_insert(GapBuf *gb, char c)
+{
+    reserve(gb, 1);
+    gb->buf[gb->gap_start++] = c;
+}
+
+void gapbuf_delete_back(GapBuf *gb, size_t n)
+{
+    gb->gap_start -= MIN(n, gb->gap_start);
+}
+
+void gapbuf_delete_fwd(GapBuf *gb, size_t n)
+{
+    gb->gap_end += MIN(n, gb->size - gb->gap_end);
+}
+
+char gapbuf_at(const GapBuf *gb, size_t i)
+{
+    return i < gb->gap_start ? gb->buf[i] : gb->buf[i + gb->gap_end - gb->gap_start];
+}
+
+/* Writes characters [from, to) to f */
+void gapbuf_fwrite(const GapBuf *gb, size_t from, size_t to, FILE *f)
+{
+    to = MIN(to, gapbuf_length(gb));
+    if (from < gb->gap_start) {
+        size_t end = MIN(to, gb->gap_start);
+        fwrite(gb->buf + from, 1, end - from, f);
+        from = end;
+    }
+    if (from < to) {
+        size_t gap = gb->gap_end - gb->gap_start;
+        fwrite(gb->buf + from + gap, 1, to - from, f);
+    }
+}
+
+/* Returns the text as a string owned by the buffer, valid until the
+ * next modification. Moves the cursor to the end. */
+char *gapbuf_str(GapBuf *gb)
+{
+    reserve(gb, 0);
+    gapbuf_move(gb, gapbuf_length(gb));
+    gb->buf[gb->gap_start] = '\0';
+    return gb->buf;
+}
+
+char *gapbuf_to_str(const GapBuf *gb) //allocates new string
+{
+    size_t len = gapbuf_length(gb);
+    char *ret = malloc(len + 1);
+    memcpy(ret, gb->buf, gb->gap_start);
+    memcpy(ret + gb->gap_start, gb->buf + gb->gap_end, len - gb->gap_start);
+    ret[len] = '\0';
+    return ret;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Text buffer with a gap at the cursor, making inserts and deletes at
+ * the cursor O(1) amortized. Characters [0, gap_start) precede the
+ * cursor and [gap_end, size) follow it. */
+typedef struct GapBuf {
+    char *buf;
+    size_t size;
+    size_t gap_start;
+    size_t gap_end;
+} GapBuf;
+
+void  gapbuf_init(GapBuf *gb, const char *str);
+void  gapbuf_destroy(GapBuf *gb);
+void  gapbuf_set(GapBuf *gb, const char *str);
+
+void  gapbuf_move(GapBuf *gb, size_t i);
+void  gapbuf_insert(GapBuf *gb, char c);
+void  gapbuf_delete_back(GapBuf *gb, size_t n);
+void  gapbuf_delete_fwd(GapBuf *gb, size_t n);
+
+char  gapbuf_at(const GapBuf *gb, size_t i);
+void  gapbuf_fwrite(const GapBuf *gb, size_t from, size_t to, FILE *f);
+char *gapbuf_str(GapBuf *gb);
+char *gapbuf_to_str(const GapBuf *gb);
+
+static inline size_t gapbuf_length(const GapBuf *gb)
+{
+    return gb->size - (gb->gap_end - gb->gap_start);
+}
+
+static inline size_t gapbuf_cursor(const GapBuf *gb)
+{
+    return gb->gap_start;
+}
@@ -0,0 +1,416 @@
+#define _DEFAULT_SOURCE
+
+#include "ics.h"
+
+#include <strings.h>
+#include <time.h>
+
+#include "common.h"
+
+#define ICS_FOLD 75        //octets per line before folding
+#define ICS_MAX_LINE 65536 //longer content lines are truncated
+
+static const char *FREQ_NAMES[] = {
+    [RECUR_DAILY] = "DAILY",
+    [RECUR_WEEKLY] = "WEEKLY",
+    [RECUR_MONTHLY] = "MONTHLY"
+};
+
+/* Writes a content line, folding it and escaping the value if it is
+ * text. Returns the column after the written text. */
+static unsigned put_text(FILE *f, unsigned col, const char *s, bool escape)
+{
+    for (; *s; s++) {
+        const char *esc = NULL;
+        if (escape) {
+            switch (*s) {
+            case '\\' : esc = "\\\\"; break;
+            case ';' : esc = "\\;"; break;
+            case ',' : esc = "\\,"; break;
+            case '\n' : esc = "\\n"; break;
+            }
+        }
+        unsigned len = esc ? strlen(esc) : 1;
+
+        //fold, but never inside a UTF-8 sequence
+        if (col + len > ICS_FOLD && ((unsigned char)*s & 0xC0) != 0x80) {
+            fputs("\r\n ", f);
+            col = 1;
+        }
+        if (esc)
+            fputs(esc, f);
+        else
+            fputc(*s, f);
+        col += len;
+    }
+    return col;
+}
+
+static void put_prop(FILE *f, const char *name, const char *value, bool escape)
+{
+    unsigned col = put_text(f, 0, name, false);
+    col = put_text(f, col, ":", false);
+    put_text(f, col, value, escape);
+    fputs("\r\n", f);
+}
+
+static void put_date(char *buf, Date d)
+{
+    sprintf(buf, "%04u%02u%02u", d.year, d.month, d.day);
+}
+
+/* iCalendar priorities run from 1, highest, to 9 */
+static const unsigned ICS_PRIORITY[] = {
+    [LOW] = 7,
+    [MEDIUM] = 5,
+    [HIGH] = 3,
+    [URGENT] = 1
+};
+
+static void export_event(FILE *f, Event e, const char *stamp)
+{
+    char buf[64];
+
+    fputs("BEGIN:VEVENT\r\n", f);
+    sprintf(buf, "%" PRIu64 "@todo", e.id);
+    put_prop(f, "UID", buf, false);
+    put_prop(f, "DTSTAMP", stamp, false);
+
+    put_date(buf, e.date);
+    if (time_is_null(e.time)) {
+        put_prop(f, "DTSTART;VALUE=DATE", buf, false);
+    } else {
+        sprintf(buf + 8, "T%02u%02u00", e.time.hour, e.time.minute);
+        put_prop(f, "DTSTART", buf, false);
+    }
+
+    if (!time_is_null(e.time) && e.duration) {
+        int len = sprintf(buf, "PT");
+        if (e.duration >= 60)
+            len += sprintf(buf + len, "%uH", e.duration / 60);
+        if (e.duration % 60)
+            sprintf(buf + len, "%uM", e.duration % 60);
+        put_prop(f, "DURATION", buf, false);
+    }
+
+    if (priority_validate(e.priority)) {
+        sprintf(buf, "%u", ICS_PRIORITY[e.priority]);
+        put_prop(f, "PRIORITY", buf, false);
+    }
+    if (e.subject)
+        put_prop(f, "SUMMARY", e.subject, true);
+    if (e.location)
+        put_prop(f, "LOCATION", e.location, true);
+    if (e.details)
+        put_prop(f, "DESCRIPTION", e.details, true);
+
+    if (e.ntags) {
+        unsigned col = put_text(f, 0, "CATEGORIES:", false);
+        for (size_t i = 0; i < e.ntags; i++) {
+            if (i)
+                col = put_text(f, col, ",", false);
+            col = put_text(f, col, e.tags[i], true);
+        }
+        fputs("\r\n", f);
+    }
+
+    if (event_is_recurring(e)) {
+        int len = sprintf(buf, "FREQ=%s;INTERVAL=%u", FREQ_NAMES[e.recur.freq], e.recur.interval);
+        if (!date_is_null(e.recur.until)) {
+            strcpy(buf + len, ";UNTIL=");
+            put_date(buf + len + 7, e.recur.until);
+            len = strlen(buf);
+        }
+        if (e.recur.count)
+            sprintf(buf + len, ";COUNT=%u", e.recur.count);
+        put_prop(f, "RRULE", buf, false);
+    }
+
+    fputs("END:VEVENT\r\n", f);
+}
+
+/* Writes every event in db to f as a VEVENT, recurring events once with
+ * their rule */
+int ics_export(Database *db, FILE *f)
+{
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm *utc = gmtime(&now);
+    strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", utc);
+
+    fputs("BEGIN:VCALENDAR\r\n", f);
+    put_prop(f, "VERSION", "2.0", false);
+    put_prop(f, "PRODID", "-//todo//EN", false);
+    StoreIter it = store_iter(db->events, 0);
+    for (Event *e; (e = store_next(&it));)
+        export_event(f, *e, stamp);
+    fputs("END:VCALENDAR\r\n", f);
+
+    return ferror(f) ? -1 : 0;
+}
+
+/* Reads a content line into buf, joining folded lines and dropping the
+ * rest of lines longer than the buffer. Returns -1 at end of file. */
+static int get_line(FILE *f, char *buf, size_t size)
+{
+    size_t n = 0;
+    int c = fgetc(f);
+    if (c == EOF)
+        return -1;
+
+    for (; c != EOF; c = fgetc(f)) {
+        if (c == '\r')
+            continue;
+        if (c == '\n') {
+            //a line starting with whitespace continues this one
+            c = fgetc(f);
+            if (c != ' ' && c != '\t') {
+                if (c != EOF)
+                    ungetc(c, f);
+                break;
+            }
+            continue;
+        }
+        if (n < size - 1)
+            buf[n++] = c;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+/* Unescapes a text value in place, stopping at an unescaped separator
+ * if sep is given. Returns the rest of the value after the separator. */
+static char *unescape(char *s, char sep)
+{
+    char *out = s;
+    for (; *s && *s != sep; s++) {
+        if (*s == '\\' && s[1]) {
+            s++;
+            *out++ = (*s == 'n' || *s == 'N') ? '\n' : *s;
+        } else {
+            *out++ = *s;
+        }
+    }
+    char *rest = *s ? s + 1 : NULL;
+    *out = '\0';
+    return rest;
+}
+
+static unsigned digits(const char *s, unsigned n)
+{
+    unsigned v = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (!isdigit((unsigned char)s[i]))
+            return -1;
+        v = v * 10 + s[i] - '0';
+    }
+    return v;
+}
+
+static Date parse_date(const char *s)
+{
+    if (strlen(s) < 8)
+        return NULL_DATE;
+    Date d = {digits(s, 4), digits(s + 4, 2), digits(s + 6, 2)};
+    return date_validate(d) ? d : NULL_DATE;
+}
+
+/* Parses a DATE or DATE-TIME value. UTC times are converted to local
+ * time, and times in other zones are taken as they are. */
+static void parse_start(const char *s, Date *d, Time *t)
+{
+    *d = parse_date(s);
+    *t = NULL_TIME;
+    if (date_is_null(*d) || s[8] != 'T' || strlen(s) < 13)
+        return;
+
+    *t = (Time){digits(s + 9, 2), digits(s + 11, 2)};
+    if (!time_validate(*t)) {
+        *t = NULL_TIME;
+    } else if (s[strlen(s) - 1] == 'Z') {
+        struct tm tm = {0};
+        tm.tm_year = d->year - 1900;
+        tm.tm_mon = d->month - 1;
+        tm.tm_mday = d->day;
+        tm.tm_hour = t->hour;
+        tm.tm_min = t->minute;
+        time_t utc = timegm(&tm);
+        struct tm *local = localtime(&utc);
+        if (local) {
+            *d = (Date){local->tm_year + 1900, local->tm_mon + 1, local->tm_mday};
+            *t = (Time){local->tm_hour, local->tm_min};
+        }
+    }
+}
+
+/* Parses the parts of an RRULE this database can represent. Rules with
+ * other parts give NULL_RECUR, leaving only the first occurrence. */
+static Recurrence parse_rule(char *s)
+{
+    Recurrence r = NULL_RECUR;
+    r.interval = 1;
+
+    for (char *part = strtok(s, ";"); part; part = strtok(NULL, ";")) {
+        char *value = strchr(part, '=');
+        if (!value)
+            return NULL_RECUR;
+        *value++ = '\0';
+
+        if (!strcasecmp(part, "FREQ")) {
+            r.freq = RECUR_NONE;
+            for (unsigned i = RECUR_DAILY; i <= RECUR_MONTHLY; i++) {
+                if (!strcasecmp(value, FREQ_NAMES[i]))
+                    r.freq = i;
+            }
+        } else if (!strcasecmp(part, "INTERVAL")) {
+            r.interval = strtoul(value, NULL, 10);
+        } else if (!strcasecmp(part, "UNTIL")) {
+            r.until = parse_date(value);
+        } else if (!strcasecmp(part, "COUNT")) {
+            r.count = strtoul(value, NULL, 10);
+        } else if (strcasecmp(part, "WKST")) {
+            return NULL_RECUR;
+        }
+    }
+
+    return recur_validate(r) && r.freq != RECUR_NONE ? r : NULL_RECUR;
+}
+
+/* Parses a DURATION value of weeks, days, hours, minutes and seconds.
+ * Gives 0 for negative or malformed durations and ones longer than an
+ * event can last. */
+static unsigned parse_duration(const char *s)
+{
+    if (*s == '+')
+        s++;
+    if (*s++ != 'P')
+        return 0;
+
+    unsigned long minutes = 0;
+    bool in_time = false;
+    while (*s) {
+        if (*s == 'T') {
+            in_time = true;
+            s++;
+            continue;
+        }
+        char *unit;
+        unsigned long n = strtoul(s, &unit, 10);
+        if (unit == s)
+            return 0;
+        switch (*unit) {
+        case 'W' : minutes += n * 7 * DAY_MINUTES; break;
+        case 'D' : minutes += n * DAY_MINUTES; break;
+        case 'H' : minutes += n * 60; break;
+        case 'M' :
+            if (!in_time)
+                return 0; //months can't be given
+            minutes += n;
+            break;
+        case 'S' : minutes += n / 60; break;
+        default : return 0;
+        }
+        if (minutes > DURATION_MAX)
+            return 0;
+        s = unit + 1;
+    }
+    return minutes;
+}
+
+static Priority parse_priority(const char *s)
+{
+    unsigned p = strtoul(s, NULL, 10);
+    if (p == 0 || p > 9)
+        return -1;
+    return p <= 2 ? URGENT : p <= 4 ? HIGH : p == 5 ? MEDIUM : LOW;
+}
+
+static void import_prop(Event *e, char *name, char *value)
+{
+    //drop parameters; times in other zones are taken as local
+    char *params = strchr(name, ';');
+    if (params)
+        *params = '\0';
+
+    if (!strcasecmp(name, "DTSTART")) {
+        Date d;
+        Time t;
+        parse_start(value, &d, &t);
+        event_set_date(e, d);
+        event_set_time(e, t);
+    } else if (!strcasecmp(name, "DURATION")) {
+        event_set_duration(e, parse_duration(value));
+    } else if (!strcasecmp(name, "PRIORITY")) {
+        event_set_priority(e, parse_priority(value));
+    } else if (!strcasecmp(name, "SUMMARY")) {
+        unescape(value, 0);
+        event_set_subject(e, value);
+    } else if (!strcasecmp(name, "LOCATION")) {
+        unescape(value, 0);
+        event_set_location(e, value);
+    } else if (!strcasecmp(name, "DESCRIPTION")) {
+        unescape(value, 0);
+        event_set_details(e, value);
+    } else if (!strcasecmp(name, "CATEGORIES")) {
+        while (value) {
+            char *tag = value;
+            value = unescape(value, ',');
+            event_add_tag(e, tag);
+        }
+    } else if (!strcasecmp(name, "RRULE")) {
+        event_set_recurrence(e, parse_rule(value));
+    }
+}
+
+/* Adds the VEVENTs read from f to db. Events without a start date are
+ * skipped. Returns the number of events added, or -1 on error. */
+int ics_import(Database *db, FILE *f)
+{
+    char *line = malloc(ICS_MAX_LINE);
+    if (!line)
+        FATAL("Failed to allocate line buffer!");
+
+    int added = 0;
+    unsigned depth = 0; //of components nested in the current event
+    bool in_event = false;
+    Event e;
+
+    database_bulk_begin(db);
+    while (get_line(f, line, ICS_MAX_LINE) != -1) {
+        char *value = strchr(line, ':');
+        if (!value)
+            continue;
+        *value++ = '\0';
+
+        if (!strcasecmp(line, "BEGIN")) {
+            if (in_event) {
+                depth++;
+            } else if (!strcasecmp(value, "VEVENT")) {
+                in_event = true;
+                event_init(&e, NULL_DATE, NULL_TIME, -1, NULL, NULL, NULL, NULL, 0);
+            }
+        } else if (!strcasecmp(line, "END")) {
+            if (!in_event)
+                continue;
+            if (depth) {
+                depth--;
+            } else {
+                in_event = false;
+                if (date_is_null(e.date)) {
+                    event_destroy(&e);
+                } else {
+                    database_bulk_add(db, e);
+                    added++;
+                }
+            }
+        } else if (in_event && !depth) {
+            import_prop(&e, line, value);
+        }
+    }
+    database_bulk_end(db);
+
+    if (in_event)
+        event_destroy(&e);
+    free(line);
+    return ferror(f) ? -1 : added;
+}
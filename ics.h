@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "database.h"
+
+/* iCalendar (RFC 5545) conversion. Both directions stream, holding one
+ * content line at a time. */
+int ics_export(Database *db, FILE *f);
+int ics_import(Database *db, FILE *f);
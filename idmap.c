@@ -0,0 +1,119 @@
+#include "idmap.h"
+
+#include "common.h"
+
+#define IDMAP_MIN_CAP 16
+
+//splitmix64 finalizer
+static inline size_t hash_id(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+void idmap_init(IdMap *m)
+{
+    m->cap = 0;
+    m->count = 0;
+    m->keys = NULL;
+    m->vals = NULL;
+}
+
+void idmap_destroy(IdMap *m)
+{
+    free(m->keys);
+    free(m->vals);
+    idmap_init(m);
+}
+
+void idmap_clear(IdMap *m)
+{
+    if (m->keys)
+        memset(m->keys, 0, m->cap * sizeof(m->keys[0]));
+    m->count = 0;
+}
+
+static void grow(IdMap *m)
+{
+    IdMap old = *m;
+    m->cap = old.cap ? old.cap * 2 : IDMAP_MIN_CAP;
+    m->count = 0;
+    m->keys = calloc(m->cap, sizeof(m->keys[0]));
+    m->vals = malloc(m->cap * sizeof(m->vals[0]));
+    if (!m->keys || !m->vals)
+        FATAL("Failed to allocate id map!");
+
+    for (size_t i = 0; i < old.cap; i++) {
+        if (old.keys[i])
+            idmap_set(m, old.keys[i], old.vals[i]);
+    }
+    free(old.keys);
+    free(old.vals);
+}
+
+void idmap_set(IdMap *m, uint64_t key, size_t val)
+{
+    //keep load factor under 3/4
+    if ((m->count + 1) * 4 > m->cap * 3)
+        grow(m);
+
+    size_t mask = m->cap - 1;
+    size_t i = hash_id(key) & mask;
+    for (; m->keys[i] && m->keys[i] != key; i = (i + 1) & mask);
+    if (!m->keys[i]) {
+        m->keys[i] = key;
+        m->count++;
+    }
+    m->vals[i] = val;
+}
+
+bool idmap_get(const IdMap *m, uint64_t key, size_t *val)
+{
+    if (!m->cap || !key)
+        return false;
+
+    size_t mask = m->cap - 1;
+    for (size_t i = hash_id(key) & mask; m->keys[i]; i = (i + 1) & mask) {
+        if (m->keys[i] == key) {
+            *val = m->vals[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void idmap_remove(IdMap *m, uint64_t key)
+{
+    if (!m->cap || !key)
+        return;
+
+    size_t mask = m->cap - 1;
+    size_t i = hash_id(key) & mask;
+    for (; m->keys[i] && m->keys[i] != key; i = (i + 1) & mask);
+    if (!m->keys[i])
+        return;
+
+    //shift back following entries which would otherwise become unreachable
+    size_t j = i;
+    for (;;) {
+        m->keys[i] = 0;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (!m->keys[j]) {
+                m->count--;
+                return;
+            }
+            size_t home = hash_id(m->keys[j]) & mask;
+            //entry at j may move to i if its home is not within (i, j]
+            if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+                break;
+        }
+        m->keys[i] = m->keys[j];
+        m->vals[i] = m->vals[j];
+        i = j;
+    }
+}
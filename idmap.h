@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Open addressing hash map from nonzero 64-bit ids to indices, using
+ * linear probing with backward shift deletion */
+typedef struct IdMap {
+    size_t cap;
+    size_t count;
+    uint64_t *keys; //0 marks an empty slot
+    size_t *vals;
+} IdMap;
+
+void idmap_init(IdMap *m);
+void idmap_destroy(IdMap *m);
+void idmap_clear(IdMap *m);
+void idmap_set(IdMap *m, uint64_t key, size_t val);
+bool idmap_get(const IdMap *m, uint64_t key, size_t *val);
+void idmap_remove(IdMap *m, uint64_t key);
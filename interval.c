@@ -0,0 +1,153 @@
+#include "interval.h"
+
+#include "common.h"
+
+struct IntervalNode {
+    Interval iv;
+    int64_t max_end;  //latest end in this subtree
+    uint64_t weight;  //heap order of the treap, from a hash of the id
+    IntervalNode *left;
+    IntervalNode *right;
+};
+
+void itree_init(IntervalTree *t)
+{
+    t->root = NULL;
+    t->count = 0;
+}
+
+static void free_nodes(IntervalNode *n)
+{
+    if (n) {
+        free_nodes(n->left);
+        free_nodes(n->right);
+        free(n);
+    }
+}
+
+void itree_destroy(IntervalTree *t)
+{
+    free_nodes(t->root);
+    itree_init(t);
+}
+
+static int compare(Interval a, Interval b)
+{
+    if (a.start != b.start)
+        return a.start < b.start ? -1 : 1;
+    return a.id < b.id ? -1 : a.id > b.id;
+}
+
+static void update(IntervalNode *n)
+{
+    n->max_end = n->iv.end;
+    if (n->left)
+        n->max_end = MAX(n->max_end, n->left->max_end);
+    if (n->right)
+        n->max_end = MAX(n->max_end, n->right->max_end);
+}
+
+/* Splits n into the nodes ordered before iv and the rest */
+static void split(IntervalNode *n, Interval iv, IntervalNode **lo, IntervalNode **hi)
+{
+    if (!n) {
+        *lo = *hi = NULL;
+    } else if (compare(n->iv, iv) < 0) {
+        split(n->right, iv, &n->right, hi);
+        update(n);
+        *lo = n;
+    } else {
+        split(n->left, iv, lo, &n->left);
+        update(n);
+        *hi = n;
+    }
+}
+
+/* Joins two treaps, all of lo ordered before hi */
+static IntervalNode *merge(IntervalNode *lo, IntervalNode *hi)
+{
+    if (!lo || !hi)
+        return lo ? lo : hi;
+    if (lo->weight > hi->weight) {
+        lo->right = merge(lo->right, hi);
+        update(lo);
+        return lo;
+    }
+    hi->left = merge(lo, hi->left);
+    update(hi);
+    return hi;
+}
+
+static IntervalNode *insert(IntervalNode *n, IntervalNode *node)
+{
+    if (!n)
+        return node;
+    if (node->weight > n->weight) {
+        split(n, node->iv, &node->left, &node->right);
+        update(node);
+        return node;
+    }
+    if (compare(node->iv, n->iv) < 0)
+        n->left = insert(n->left, node);
+    else
+        n->right = insert(n->right, node);
+    update(n);
+    return n;
+}
+
+void itree_insert(IntervalTree *t, Interval iv)
+{
+    IntervalNode *node = malloc(sizeof(*node));
+    if (!node)
+        FATAL("Failed to allocate interval!");
+    *node = (IntervalNode){iv, iv.end, hash_bytes(&iv.id, sizeof(iv.id), iv.start), NULL, NULL};
+    t->root = insert(t->root, node);
+    t->count++;
+}
+
+static IntervalNode *remove_node(IntervalNode *n, Interval iv, bool *found)
+{
+    if (!n)
+        return NULL;
+    int cmp = compare(iv, n->iv);
+    if (!cmp) {
+        IntervalNode *joined = merge(n->left, n->right);
+        free(n);
+        *found = true;
+        return joined;
+    }
+    if (cmp < 0)
+        n->left = remove_node(n->left, iv, found);
+    else
+        n->right = remove_node(n->right, iv, found);
+    update(n);
+    return n;
+}
+
+/* Removes the interval with the start and id of iv, if there is one */
+void itree_remove(IntervalTree *t, Interval iv)
+{
+    bool found = false;
+    t->root = remove_node(t->root, iv, &found);
+    t->count -= found;
+}
+
+static void overlaps(const IntervalNode *n, int64_t start, int64_t end, interval_fn fn, void *data)
+{
+    if (!n || n->max_end <= start)
+        return;
+    overlaps(n->left, start, end, fn, data);
+    if (n->iv.start >= end)
+        return;
+    if (n->iv.end > start)
+        fn(n->iv, data);
+    overlaps(n->right, start, end, fn, data);
+}
+
+/* Calls fn on each interval overlapping start to end, in order of
+ * start. Subtrees ending before start or beginning after end are not
+ * visited, taking O((k + 1) log n) for k overlaps. */
+void itree_overlaps(const IntervalTree *t, int64_t start, int64_t end, interval_fn fn, void *data)
+{
+    overlaps(t->root, start, end, fn, data);
+}
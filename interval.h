@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Half open span of minutes, start <= m < end, belonging to an event */
+typedef struct Interval {
+    int64_t start;
+    int64_t end;
+    uint64_t id;
+} Interval;
+
+typedef struct IntervalNode IntervalNode;
+
+/* Treap of intervals ordered by start then id, each node keeping the
+ * latest end in its subtree so that searches skip subtrees ending
+ * before the span looked for */
+typedef struct IntervalTree {
+    IntervalNode *root;
+    size_t count;
+} IntervalTree;
+
+typedef void (*interval_fn)(Interval iv, void *data);
+
+void itree_init(IntervalTree *t);
+void itree_destroy(IntervalTree *t);
+void itree_insert(IntervalTree *t, Interval iv);
+void itree_remove(IntervalTree *t, Interval iv);
+void itree_overlaps(const IntervalTree *t, int64_t start, int64_t end, interval_fn fn, void *data);
@@ -0,0 +1,198 @@
+#include "pager.h"
+
+#include <unistd.h>
+
+#include "common.h"
+#include "stredit.h"
+
+/* Events paged through, read by position so that only those on the
+ * visible page are looked at */
+typedef struct Source {
+    size_t n;
+    Event (*at)(const struct Source *src, size_t i);
+    size_t (*find_date)(const struct Source *src, Date d);
+    Event *arr;
+    EventStore *store;
+} Source;
+
+static Event arr_at(const Source *src, size_t i)
+{
+    return src->arr[i];
+}
+
+static size_t arr_find_date(const Source *src, Date d)
+{
+    return event_arr_find_date(src->arr, src->n, d);
+}
+
+static Event store_event_at(const Source *src, size_t i)
+{
+    return *store_at(src->store, i);
+}
+
+/* Returns the position of the first event on or after d */
+static size_t store_find_date(const Source *src, Date d)
+{
+    Event start = {.date = d, .time = NULL_TIME};
+    return store_lower_bound(src->store, event_sort_key(start));
+}
+
+static inline uint16_t page_flags(const Source *src, Event e, unsigned i, unsigned top, uint16_t flags)
+{
+    if (i != top && !date_compare(e.date, src->at(src, i - 1).date))
+        flags &= ~PRINT_DATE;
+    return flags;
+}
+
+/* Returns index one past the last event which fits on a page starting
+ * at top. Only looks at as many events as fit on the screen. */
+static unsigned page_end(const Source *src, unsigned top, uint16_t flags, vec2 dim)
+{
+    unsigned avail = dim.y > 2 ? dim.y - 1 : 1; //leave room for status line
+    unsigned rows = 1;
+    unsigned i;
+    for (i = top; i < src->n; i++) {
+        Event e = src->at(src, i);
+        rows += event_fprint_lines(e, page_flags(src, e, i, top, flags), dim.x);
+        if (rows > avail) {
+            if (i == top)
+                i++;
+            break;
+        }
+    }
+    return i;
+}
+
+/* Returns index of the first event of the page preceding top */
+static unsigned page_prev(const Source *src, unsigned top, uint16_t flags, vec2 dim)
+{
+    unsigned avail = dim.y > 2 ? dim.y - 1 : 1;
+    unsigned rows = 1;
+    unsigned i = top;
+    while (i > 0) {
+        unsigned j = i - 1;
+        Event e = src->at(src, j);
+        //j could become the top of the page and gain a date header
+        if (rows + event_fprint_lines(e, flags, dim.x) > avail && i < top)
+            break;
+        rows += event_fprint_lines(e, page_flags(src, e, j, 0, flags), dim.x);
+        i = j;
+    }
+    return i;
+}
+
+static unsigned render_page(const Source *src, unsigned top, uint16_t flags, vec2 dim)
+{
+    unsigned end = page_end(src, top, flags, dim);
+
+    printf("\033[H\033[2J\n");
+    for (unsigned i = top; i < end; i++) {
+        Event e = src->at(src, i);
+        event_print(e, page_flags(src, e, i, top, flags));
+    }
+
+    PRTESC(BOLD);
+    printf("-- %u-%u of %zu (space: next, b: back, g: go to date, q: quit) --",
+           top + 1, end, src->n);
+    PRTESC(RESET);
+    fflush(stdout);
+
+    return end;
+}
+
+/* Prints all events in order, as event_print_arr does */
+static void print_all(const Source *src, uint16_t flags)
+{
+    if (!src->store) { //the array may be NULL when empty
+        event_print_arr(src->arr, src->n, flags);
+        return;
+    }
+
+    if (src->n > 0)
+        printf("\n");
+    StoreIter it = store_iter(src->store, 0);
+    Date last_date = {0};
+    for (Event *e; (e = store_next(&it));) {
+        uint16_t pflgs = flags;
+        if (!date_compare(e->date, last_date))
+            pflgs &= ~PRINT_DATE;
+        else
+            last_date = e->date;
+        event_print(*e, pflgs);
+    }
+}
+
+/* Prints events one screen at a time, formatting only the visible
+ * page. Falls back to printing them all when not attached to a terminal
+ * or when all events fit on one screen. */
+static void page(const Source *src, uint16_t flags, pager_date_fn parse_date)
+{
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        print_all(src, flags);
+        return;
+    }
+
+    start_noncannon();
+    vec2 dim = get_term_size();
+    if (page_end(src, 0, flags, dim) == src->n) {
+        end_noncannon();
+        print_all(src, flags);
+        return;
+    }
+
+    unsigned top = 0;
+    for (bool done = false; !done;) {
+        dim = get_term_size();
+        unsigned end = render_page(src, top, flags, dim);
+
+        switch (term_getchar()) {
+        case ' ':
+        case 'f':
+        case 'n':
+            if (end < src->n)
+                top = end;
+            break;
+        case 'b':
+        case 'p':
+            top = page_prev(src, top, flags, dim);
+            break;
+        case 'g': {
+            printf("\r\033[KGo to date: ");
+            end_noncannon();
+            char *line = stredit(NULL);
+            char *remaining = line;
+            Date d = parse_date(&remaining);
+            if (date_validate(d)) {
+                top = src->find_date(src, d);
+                if (top == src->n)
+                    top = page_prev(src, src->n, flags, dim);
+            }
+            free(line);
+            start_noncannon();
+            break;
+        }
+        case 'q':
+        case EOF:
+            done = true;
+            break;
+        }
+    }
+
+    printf("\r\033[K");
+    end_noncannon();
+}
+
+void pager_print_arr(Event *e, size_t n, uint16_t flags, pager_date_fn parse_date)
+{
+    Source src = {n, arr_at, arr_find_date, e, NULL};
+    page(&src, flags, parse_date);
+}
+
+/* Pages through the events of a store in place, reading each visible
+ * event by its position, so nothing is copied and the first screen
+ * costs O(log n) per event shown whatever the size of the store */
+void pager_print_store(EventStore *s, uint16_t flags, pager_date_fn parse_date)
+{
+    Source src = {store_count(s), store_event_at, store_find_date, NULL, s};
+    page(&src, flags, parse_date);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "event.h"
+#include "store.h"
+
+/* Parses a date from the tokens at *line, as get_date_from_toks does */
+typedef Date (*pager_date_fn)(char **line);
+
+void pager_print_arr(Event *e, size_t n, uint16_t flags, pager_date_fn parse_date);
+void pager_print_store(EventStore *s, uint16_t flags, pager_date_fn parse_date);
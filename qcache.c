@@ -0,0 +1,90 @@
+#include "qcache.h"
+
+#include "common.h"
+
+static uint64_t hash_key(const char *key)
+{
+    uint64_t h = hash_bytes(key, strlen(key), 0);
+    return h ? h : 1; //0 marks an empty slot
+}
+
+void qcache_init(QueryCache *c)
+{
+    for (unsigned i = 0; i < QCACHE_CAP; i++)
+        c->entries[i] = (CacheEntry){NULL, 0, 0, NULL, 0};
+    c->count = 0;
+    c->clock = 0;
+    idmap_init(&c->slots);
+}
+
+void qcache_destroy(QueryCache *c)
+{
+    for (unsigned i = 0; i < c->count; i++) {
+        free(c->entries[i].key);
+        free(c->entries[i].events);
+    }
+    idmap_destroy(&c->slots);
+    qcache_init(c);
+}
+
+/* Copies the results cached for key at revision into *events. Returns
+ * false on a miss. */
+bool qcache_get(QueryCache *c, const char *key, uint64_t revision, Event **events, size_t *size)
+{
+    size_t i;
+    if (!idmap_get(&c->slots, hash_key(key), &i))
+        return false;
+
+    CacheEntry *e = &c->entries[i];
+    if (e->revision != revision || strcmp(e->key, key))
+        return false;
+
+    *events = NULL;
+    if (e->size) {
+        if (!(*events = malloc(e->size * sizeof(e->events[0]))))
+            return false;
+        memcpy(*events, e->events, e->size * sizeof(e->events[0]));
+    }
+    *size = e->size;
+    e->used = ++c->clock;
+    return true;
+}
+
+/* Returns the entry to keep key in: the one already holding it, an
+ * unused one, or else the least recently used */
+static CacheEntry *slot_for(QueryCache *c, uint64_t h)
+{
+    size_t i;
+    if (idmap_get(&c->slots, h, &i))
+        return &c->entries[i];
+    if (c->count < QCACHE_CAP) {
+        i = c->count++;
+    } else {
+        i = 0;
+        for (unsigned j = 1; j < QCACHE_CAP; j++) {
+            if (c->entries[j].used < c->entries[i].used)
+                i = j;
+        }
+        idmap_remove(&c->slots, hash_key(c->entries[i].key));
+    }
+    idmap_set(&c->slots, h, i);
+    return &c->entries[i];
+}
+
+/* Keeps a copy of the results of key, read at revision */
+void qcache_put(QueryCache *c, const char *key, uint64_t revision, const Event *events, size_t size)
+{
+    if (size > QCACHE_MAX_EVENTS)
+        return;
+
+    Event *copy = NULL;
+    if (size && !(copy = malloc(size * sizeof(copy[0]))))
+        return;
+    if (size)
+        memcpy(copy, events, size * sizeof(copy[0]));
+
+    CacheEntry *e = slot_for(c, hash_key(key));
+    free(e->key);
+    free(e->events);
+    *e = (CacheEntry){str_dup(key), revision, ++c->clock, copy, size};
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "event.h"
+#include "idmap.h"
+
+#define QCACHE_CAP 32          //results kept at once
+#define QCACHE_MAX_EVENTS 4096 //larger results are not kept
+
+typedef struct CacheEntry {
+    char *key;         //normalized query, NULL while unused
+    uint64_t revision; //of the database the results were read from
+    uint64_t used;     //time of last use, by the cache's clock
+    Event *events;     //shallow copies, only valid at revision
+    size_t size;
+} CacheEntry;
+
+/* Least recently used cache of query results, keyed by a normalized
+ * form of the query. Entries read from an older revision of the
+ * database are never returned. */
+typedef struct QueryCache {
+    CacheEntry entries[QCACHE_CAP];
+    unsigned count;
+    uint64_t clock;
+    IdMap slots; //hash of key to its entry
+} QueryCache;
+
+void qcache_init(QueryCache *c);
+void qcache_destroy(QueryCache *c);
+bool qcache_get(QueryCache *c, const char *key, uint64_t revision, Event **events, size_t *size);
+void qcache_put(QueryCache *c, const char *key, uint64_t revision, const Event *events, size_t size);
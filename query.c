@@ -0,0 +1,385 @@
+#define _DEFAULT_SOURCE
+
+#include "query.h"
+
+#include <ctype.h>
+
+#include "common.h"
+
+#define FETCH_COST 4 //of reading an event by id, relative to reading the next
+
+static const Date FIRST_DATE = {0, 1, 1}; //sorts before any valid date
+
+static const char *CMP_TEXT[] = {
+    [QUERY_LT] = "<",
+    [QUERY_EQ] = "=",
+    [QUERY_GT] = ">",
+    [QUERY_LT | QUERY_EQ] = "<=",
+    [QUERY_GT | QUERY_EQ] = ">=",
+    [QUERY_LT | QUERY_GT] = "!="
+};
+
+Query *query_new(QueryOp op, Query *left, Query *right)
+{
+    Query *q = malloc(sizeof(*q));
+    if (!q)
+        FATAL("Failed to allocate query!");
+    *q = (Query){op, left, right, NULL, -1, 0, NULL_DATE, NULL_DATE};
+    return q;
+}
+
+void query_free(Query *q)
+{
+    if (q) {
+        query_free(q->left);
+        query_free(q->right);
+        free(q->text);
+        free(q);
+    }
+}
+
+/* Whether word appears in s, ignoring case */
+static bool contains(const char *s, const char *word)
+{
+    if (!s)
+        return false;
+
+    size_t n = strlen(word);
+    for (; *s; s++) {
+        size_t i;
+        for (i = 0; i < n && tolower((unsigned char)s[i]) == tolower((unsigned char)word[i]); i++);
+        if (i == n)
+            return true;
+    }
+    return false;
+}
+
+bool query_match(const Query *q, Event e)
+{
+    switch (q->op) {
+    case QUERY_AND :
+        return query_match(q->left, e) && query_match(q->right, e);
+    case QUERY_OR :
+        return query_match(q->left, e) || query_match(q->right, e);
+    case QUERY_NOT :
+        return !query_match(q->left, e);
+    case QUERY_TAG :
+        return event_contains_tag(e, q->text);
+    case QUERY_PRIORITY :
+        if (!priority_validate(e.priority))
+            return false;
+        return q->cmp & (e.priority < q->priority ? QUERY_LT :
+                         e.priority > q->priority ? QUERY_GT : QUERY_EQ);
+    case QUERY_DATE :
+        return !date_is_null(e.date) &&
+            (date_is_null(q->from) || date_compare(e.date, q->from) >= 0) &&
+            (date_is_null(q->to) || date_compare(e.date, q->to) <= 0);
+    case QUERY_TEXT :
+        return contains(e.subject, q->text) ||
+            contains(e.location, q->text) ||
+            contains(e.details, q->text);
+    }
+    return false;
+}
+
+static void fprint_dates(Date from, Date to, FILE *f)
+{
+    char buf[DATE_STR_LEN];
+    if (!date_is_null(from) && !date_compare(from, to)) {
+        date_format(from, buf);
+        fprintf(f, "on %s", buf);
+        return;
+    }
+    if (!date_is_null(from)) {
+        date_format(from, buf);
+        fprintf(f, "from %s%s", buf, date_is_null(to) ? "" : " ");
+    }
+    if (!date_is_null(to)) {
+        date_format(to, buf);
+        fprintf(f, "to %s", buf);
+    }
+}
+
+/* Prints an operand of parent, bracketed if it would otherwise bind
+ * differently */
+static void fprint_operand(const Query *q, QueryOp parent, FILE *f)
+{
+    bool paren = (q->op == QUERY_AND || q->op == QUERY_OR) && q->op != parent;
+    if (paren)
+        fputc('(', f);
+    query_fprint(q, f);
+    if (paren)
+        fputc(')', f);
+}
+
+void query_fprint(const Query *q, FILE *f)
+{
+    switch (q->op) {
+    case QUERY_AND :
+    case QUERY_OR :
+        fprint_operand(q->left, q->op, f);
+        fputs(q->op == QUERY_AND ? " and " : " or ", f);
+        fprint_operand(q->right, q->op, f);
+        break;
+    case QUERY_NOT :
+        fputs("not ", f);
+        fprint_operand(q->left, q->op, f);
+        break;
+    case QUERY_TAG :
+        fprintf(f, "tag %s", q->text);
+        break;
+    case QUERY_PRIORITY :
+        fprintf(f, "priority %s %s", CMP_TEXT[q->cmp], priority_to_str(q->priority));
+        break;
+    case QUERY_DATE :
+        fprint_dates(q->from, q->to, f);
+        break;
+    case QUERY_TEXT :
+        fprintf(f, "text %s", q->text);
+        break;
+    }
+}
+
+/* Returns the position of the first event on or after d */
+static size_t date_rank(Database *db, Date d)
+{
+    Event start = {.date = d, .time = NULL_TIME};
+    return store_lower_bound(db->events, event_sort_key(start));
+}
+
+/* Sets *lo and *hi to the positions of the events between from and to
+ * inclusive, either of which may be open */
+static void date_ranks(Database *db, Date from, Date to, size_t *lo, size_t *hi)
+{
+    *lo = date_rank(db, date_is_null(from) ? FIRST_DATE : from);
+    *hi = date_is_null(to) ? store_count(db->events) : date_rank(db, date_add_days(to, 1));
+    *hi = MAX(*lo, *hi);
+}
+
+/* Appends the operands of the and at the top of q to *list */
+static void conjuncts(const Query *q, const Query ***list, size_t *n)
+{
+    if (q->op == QUERY_AND) {
+        conjuncts(q->left, list, n);
+        conjuncts(q->right, list, n);
+    } else {
+        *list = add_element(*list, n, sizeof((*list)[0]), *n, &q);
+    }
+}
+
+/* Picks the access path reading the fewest events, going by the size of
+ * the date range, found by binary search, and of the posting list of
+ * each tag the query requires. The conjuncts the path already ensures
+ * are left out of the filter. */
+void query_plan(Database *db, const Query *q, QueryPlan *plan)
+{
+    const Query **conj = NULL;
+    size_t n = 0;
+    conjuncts(q, &conj, &n);
+
+    plan->path = PATH_SCAN;
+    plan->total = store_count(db->events);
+    plan->rows = plan->total;
+    plan->from = NULL_DATE;
+    plan->to = NULL_DATE;
+    plan->tag = NULL;
+
+    bool dated = false;
+    for (size_t i = 0; i < n; i++) {
+        const Query *c = conj[i];
+        if (c->op != QUERY_DATE)
+            continue;
+        dated = true;
+        if (!date_is_null(c->from) &&
+            (date_is_null(plan->from) || date_compare(c->from, plan->from) > 0))
+            plan->from = c->from;
+        if (!date_is_null(c->to) &&
+            (date_is_null(plan->to) || date_compare(c->to, plan->to) < 0))
+            plan->to = c->to;
+    }
+
+    size_t cost = plan->rows;
+    if (dated) {
+        size_t lo, hi;
+        date_ranks(db, plan->from, plan->to, &lo, &hi);
+        plan->path = PATH_RANGE;
+        plan->rows = hi - lo;
+        cost = plan->rows;
+    }
+    for (size_t i = 0; i < n; i++) {
+        int bit = conj[i]->op == QUERY_TAG ? tag_lookup(conj[i]->text) : -1;
+        if (bit == -1)
+            continue;
+        size_t rows = db->postings[bit].count;
+        if (rows * FETCH_COST < cost) {
+            plan->path = PATH_TAG;
+            plan->tag = conj[i];
+            plan->rows = rows;
+            cost = rows * FETCH_COST;
+        }
+    }
+
+    plan->nfilter = 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((plan->path == PATH_RANGE && conj[i]->op == QUERY_DATE) ||
+            (plan->path == PATH_TAG && conj[i] == plan->tag))
+            continue;
+        conj[plan->nfilter++] = conj[i];
+    }
+    plan->filter = conj;
+}
+
+void query_plan_destroy(QueryPlan *plan)
+{
+    free(plan->filter);
+    plan->filter = NULL;
+    plan->nfilter = 0;
+}
+
+/* Whether the events of recurring series are read as their occurrences
+ * between the date bounds, which requires both */
+static bool expands(const QueryPlan *plan)
+{
+    return !date_is_null(plan->from) && !date_is_null(plan->to);
+}
+
+void query_plan_fprint(const QueryPlan *plan, FILE *f)
+{
+    switch (plan->path) {
+    case PATH_SCAN :
+        fputs("Scan all events", f);
+        break;
+    case PATH_RANGE :
+        fputs("Binary search events ", f);
+        fprint_dates(plan->from, plan->to, f);
+        break;
+    case PATH_TAG :
+        fprintf(f, "Read posting list of tag %s", plan->tag->text);
+        break;
+    }
+    fprintf(f, " (%zu of %zu events)\n", plan->rows, plan->total);
+
+    if (plan->nfilter) {
+        fputs("Filter by ", f);
+        for (size_t i = 0; i < plan->nfilter; i++) {
+            if (i)
+                fputs(" and ", f);
+            if (plan->nfilter > 1)
+                fprint_operand(plan->filter[i], QUERY_AND, f);
+            else
+                query_fprint(plan->filter[i], f);
+        }
+        fputc('\n', f);
+    }
+    if (expands(plan)) {
+        fputs("Add occurrences of recurring events ", f);
+        fprint_dates(plan->from, plan->to, f);
+        fputc('\n', f);
+    }
+}
+
+static int append(Event **events, size_t *size, size_t *cap, Event e)
+{
+    if (*size == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        Event *grown = realloc(*events, *cap * sizeof(grown[0]));
+        if (!grown)
+            return -1;
+        *events = grown;
+    }
+    (*events)[(*size)++] = e;
+    return 0;
+}
+
+static bool filter(const QueryPlan *plan, Event e)
+{
+    if (expands(plan) && event_is_recurring(e))
+        return false;
+    for (size_t i = 0; i < plan->nfilter; i++) {
+        if (!query_match(plan->filter[i], e))
+            return false;
+    }
+    return true;
+}
+
+static int sort_wrapper(const void *a, const void *b)
+{
+    return event_sort_time(*(Event *)a, *(Event *)b);
+}
+
+/* Reads the events matching q along plan into *events, in order */
+static int run(Database *db, const Query *q, const QueryPlan *plan,
+               Event **events, size_t *size, size_t *cap)
+{
+    if (plan->path == PATH_TAG) {
+        const IdMap *ids = &db->postings[tag_lookup(plan->tag->text)];
+        for (size_t i = 0; i < ids->cap; i++) {
+            Event *e = ids->keys[i] ? database_get_event(db, ids->keys[i]) : NULL;
+            if (e && filter(plan, *e) && append(events, size, cap, *e) == -1)
+                return -1;
+        }
+        if (*size)
+            qsort(*events, *size, sizeof((*events)[0]), sort_wrapper);
+    } else {
+        size_t lo = 0, hi = store_count(db->events);
+        if (plan->path == PATH_RANGE)
+            date_ranks(db, plan->from, plan->to, &lo, &hi);
+        StoreIter it = store_iter(db->events, lo);
+        Event *e;
+        for (; lo < hi && (e = store_next(&it)); lo++) {
+            if (filter(plan, *e) && append(events, size, cap, *e) == -1)
+                return -1;
+        }
+    }
+
+    if (!expands(plan))
+        return 0;
+
+    size_t nplain = *size;
+    for (size_t i = 0; i < db->nrecurring; i++) {
+        Event o = db->recurring[i];
+        for (Date d = recur_next(o.recur, o.date, plan->from);
+             !date_is_null(d) && date_compare(d, plan->to) <= 0;
+             d = recur_next(o.recur, o.date, date_add_days(d, 1))) {
+            Event occ = o;
+            event_set_date(&occ, d);
+            if (query_match(q, occ) && append(events, size, cap, occ) == -1)
+                return -1;
+        }
+    }
+    if (*size > nplain)
+        qsort(*events, *size, sizeof((*events)[0]), sort_wrapper);
+
+    return 0;
+}
+
+/* Finds the events matching q along plan, in order. Events share
+ * strings with the database. */
+int query_run(Database *db, const Query *q, const QueryPlan *plan, Event **events, size_t *size)
+{
+    if (!events)
+        return -1;
+
+    //the printed query, with dates resolved, is the same for equal queries
+    char *key = NULL;
+    size_t len;
+    FILE *f = open_memstream(&key, &len);
+    if (!f)
+        return -1;
+    fputs("find ", f);
+    query_fprint(q, f);
+    fclose(f);
+    if (qcache_get(&db->cache, key, db->revision, events, size)) {
+        free(key);
+        return 0;
+    }
+
+    *events = NULL;
+    *size = 0;
+    size_t cap = 0;
+    int err = run(db, q, plan, events, size, &cap);
+    if (!err)
+        qcache_put(&db->cache, key, db->revision, *events, *size);
+    free(key);
+    return err;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "database.h"
+
+typedef enum QueryOp {
+    QUERY_AND,
+    QUERY_OR,
+    QUERY_NOT,
+    QUERY_TAG,
+    QUERY_PRIORITY,
+    QUERY_DATE,
+    QUERY_TEXT
+} QueryOp;
+
+/* Orderings of an event's priority to the compared one that match */
+#define QUERY_LT 0x1
+#define QUERY_EQ 0x2
+#define QUERY_GT 0x4
+
+/* Expression tree of a find command */
+typedef struct Query {
+    QueryOp op;
+    struct Query *left;  //operands of and and or, and of not
+    struct Query *right;
+    char *text;          //tag or text to look for
+    Priority priority;
+    unsigned cmp;        //QUERY_LT, QUERY_EQ and QUERY_GT that match
+    Date from;           //date bounds, NULL_DATE when open
+    Date to;
+} Query;
+
+typedef enum QueryPath {
+    PATH_SCAN,  //every event
+    PATH_RANGE, //events between two dates, found by binary search
+    PATH_TAG    //events on the posting list of a tag
+} QueryPath;
+
+/* How a query is run: the events read by the access path, and the
+ * conjuncts of the query still to be checked on each */
+typedef struct QueryPlan {
+    QueryPath path;
+    size_t rows;  //events the path reads
+    size_t total; //events in the database
+    Date from;    //date bounds over all of the query
+    Date to;
+    const Query *tag;
+    const Query **filter;
+    size_t nfilter;
+} QueryPlan;
+
+Query *query_new(QueryOp op, Query *left, Query *right);
+void   query_free(Query *q);
+bool   query_match(const Query *q, Event e);
+void   query_fprint(const Query *q, FILE *f);
+
+void query_plan(Database *db, const Query *q, QueryPlan *plan);
+void query_plan_destroy(QueryPlan *plan);
+void query_plan_fprint(const QueryPlan *plan, FILE *f);
+int  query_run(Database *db, const Query *q, const QueryPlan *plan, Event **events, size_t *size);
@@ -0,0 +1,248 @@
+#include "recur.h"
+
+#include "common.h"
+
+static const char *FREQ_TEXT[] = {
+    "none",
+    "daily",
+    "weekly",
+    "monthly"
+};
+
+static const char *UNIT_TEXT[] = {
+    "",
+    "days",
+    "weeks",
+    "months"
+};
+
+/* Safety bound on skipped months, e.g. monthly on the 31st */
+#define MAX_MONTH_SKIP 4800
+
+static RecurFreq freq_from_unit(const char *str)
+{
+    for (unsigned f = RECUR_DAILY; f <= RECUR_MONTHLY; f++) {
+        size_t len = strlen(UNIT_TEXT[f]);
+        //accept singular as well as plural
+        if (!strcmp(str, UNIT_TEXT[f]) ||
+            (strlen(str) == len - 1 && !strncmp(str, UNIT_TEXT[f], len - 1)))
+            return f;
+    }
+    return -1;
+}
+
+static bool parse_unsigned(const char *tok, unsigned *n)
+{
+    char *endptr;
+    if (!tok)
+        return false;
+    long val = strtol(tok, &endptr, 10);
+    if (*endptr != '\0' || endptr == tok || val <= 0)
+        return false;
+    *n = val;
+    return true;
+}
+
+/* Parses a rule of the form
+ *     daily|weekly|monthly|every N days|weeks|months [until DATE] [count N]
+ * Returns NULL_RECUR for an empty string or "none", and a rule failing
+ * recur_validate if malformed. */
+Recurrence recur_from_str(char *str)
+{
+    Recurrence r = NULL_RECUR;
+    Recurrence bad = NULL_RECUR;
+    bad.freq = -1;
+
+    char *tok = next_tok(&str);
+    if (!tok || !strcmp(tok, FREQ_TEXT[RECUR_NONE])) {
+        free(tok);
+        return r;
+    }
+
+    r.interval = 1;
+    if (!strcmp(tok, "every")) {
+        free(tok);
+        tok = next_tok(&str);
+        bool ok = parse_unsigned(tok, &r.interval);
+        free(tok);
+        if (!ok)
+            return bad;
+        tok = next_tok(&str);
+        r.freq = tok ? freq_from_unit(tok) : -1;
+    } else {
+        r.freq = -1;
+        for (unsigned f = RECUR_DAILY; f <= RECUR_MONTHLY; f++) {
+            if (!strcmp(tok, FREQ_TEXT[f]))
+                r.freq = f;
+        }
+    }
+    free(tok);
+    if (!recur_validate(r))
+        return bad;
+
+    while ((tok = next_tok(&str))) {
+        char *arg = next_tok(&str);
+        bool ok = arg != NULL;
+        if (ok && !strcmp(tok, "until")) {
+            r.until = date_from_str(arg);
+            ok = date_validate(r.until);
+        } else if (ok && !strcmp(tok, "count")) {
+            ok = parse_unsigned(arg, &r.count);
+        } else {
+            ok = false;
+        }
+        free(tok);
+        free(arg);
+        if (!ok)
+            return bad;
+    }
+
+    return r;
+}
+
+char *recur_to_str(Recurrence r) //allocates new string
+{
+    if (!recur_validate(r))
+        return str_dup("Invalid recurrence!");
+    if (recur_is_null(r))
+        return str_dup("");
+
+    char *ret = malloc(64);
+    int len;
+    if (r.interval == 1)
+        len = sprintf(ret, "%s", FREQ_TEXT[r.freq]);
+    else
+        len = sprintf(ret, "every %u %s", r.interval, UNIT_TEXT[r.freq]);
+    if (!date_is_null(r.until))
+        len += sprintf(ret + len, " until %02u/%02u/%04u", r.until.month, r.until.day, r.until.year);
+    if (r.count)
+        sprintf(ret + len, " count %u", r.count);
+    return ret;
+}
+
+void recur_fprint(Recurrence r, FILE *f)
+{
+    char *str = recur_to_str(r);
+    fprintf(f, "%s\n", str);
+    free(str);
+}
+
+bool recur_equal(Recurrence r1, Recurrence r2)
+{
+    if (recur_is_null(r1) || recur_is_null(r2))
+        return recur_is_null(r1) == recur_is_null(r2);
+    return r1.freq == r2.freq && r1.interval == r2.interval &&
+        !date_compare(r1.until, r2.until) && r1.count == r2.count;
+}
+
+bool recur_validate(Recurrence r)
+{
+    return r.freq == RECUR_NONE ||
+        (r.freq >= RECUR_DAILY && r.freq <= RECUR_MONTHLY && r.interval > 0);
+}
+
+bool recur_is_null(Recurrence r)
+{
+    return r.freq == RECUR_NONE;
+}
+
+static inline long months_between(Date from, Date to)
+{
+    return ((long)to.year - (long)from.year) * 12 + (long)to.month - (long)from.month;
+}
+
+static Date add_months(Date d, unsigned long months)
+{
+    unsigned long m = d.month - 1 + months;
+    d.year += m / 12;
+    d.month = m % 12 + 1;
+    return d;
+}
+
+/* Returns the date of occurrence k of the series, which may not be a
+ * valid date for monthly rules, or NULL_DATE if past the bounds */
+static Date nth_occurrence(Recurrence r, Date start, unsigned long k)
+{
+    Date d;
+    if (r.count && k >= r.count)
+        return NULL_DATE;
+
+    switch (r.freq) {
+    case RECUR_DAILY:
+        d = date_from_days(date_to_days(start) + k * r.interval);
+        break;
+    case RECUR_WEEKLY:
+        d = date_from_days(date_to_days(start) + k * r.interval * 7);
+        break;
+    case RECUR_MONTHLY:
+        d = add_months(start, k * r.interval);
+        break;
+    default:
+        return k == 0 ? start : NULL_DATE;
+    }
+
+    if (!date_is_null(r.until) && date_compare(d, r.until) > 0)
+        return NULL_DATE;
+    return d;
+}
+
+bool recur_occurs_on(Recurrence r, Date start, Date d)
+{
+    if (date_compare(d, start) < 0)
+        return false;
+
+    long k;
+    switch (r.freq) {
+    case RECUR_DAILY:
+    case RECUR_WEEKLY: {
+        long period = r.interval * (r.freq == RECUR_WEEKLY ? 7 : 1);
+        long diff = date_to_days(d) - date_to_days(start);
+        if (diff % period)
+            return false;
+        k = diff / period;
+        break;
+    }
+    case RECUR_MONTHLY: {
+        long diff = months_between(start, d);
+        if (d.day != start.day || diff % r.interval)
+            return false;
+        k = diff / r.interval;
+        break;
+    }
+    default:
+        return !date_compare(d, start);
+    }
+
+    return !date_is_null(nth_occurrence(r, start, k));
+}
+
+/* Returns the first occurrence on or after from, or NULL_DATE */
+Date recur_next(Recurrence r, Date start, Date from)
+{
+    unsigned long k = 0;
+    if (date_compare(from, start) > 0) {
+        switch (r.freq) {
+        case RECUR_DAILY:
+        case RECUR_WEEKLY: {
+            long period = r.interval * (r.freq == RECUR_WEEKLY ? 7 : 1);
+            long diff = date_to_days(from) - date_to_days(start);
+            k = (diff + period - 1) / period;
+            break;
+        }
+        case RECUR_MONTHLY:
+            k = months_between(start, from) / r.interval;
+            break;
+        default:
+            return NULL_DATE;
+        }
+    }
+
+    for (unsigned i = 0; i < MAX_MONTH_SKIP; i++, k++) {
+        Date d = nth_occurrence(r, start, k);
+        if (date_is_null(d))
+            return NULL_DATE;
+        if (date_validate(d) && date_compare(d, from) >= 0)
+            return d;
+    }
+    return NULL_DATE;
+}
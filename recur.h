@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "date.h"
+
+typedef enum RecurFreq {
+    RECUR_NONE,
+    RECUR_DAILY,
+    RECUR_WEEKLY,
+    RECUR_MONTHLY
+} RecurFreq;
+
+/* Repetition rule of an event. The event's own date is the first
+ * occurrence; until and count optionally bound the series. */
+typedef struct Recurrence {
+    RecurFreq freq;
+    unsigned interval;
+    Date until;
+    unsigned count;
+} Recurrence;
+
+static Recurrence NULL_RECUR = {RECUR_NONE, 0, {-1, -1, -1}, 0};
+
+Recurrence recur_from_str(char *str);
+char      *recur_to_str(Recurrence r);
+void       recur_fprint(Recurrence r, FILE *f);
+bool       recur_equal(Recurrence r1, Recurrence r2);
+bool       recur_validate(Recurrence r);
+bool       recur_is_null(Recurrence r);
+bool       recur_occurs_on(Recurrence r, Date start, Date d);
+Date       recur_next(Recurrence r, Date start, Date from);
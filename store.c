@@ -0,0 +1,98 @@
+#include "store.h"
+
+#include "common.h"
+
+/* Sorted array of events, grown by doubling */
+struct EventStore {
+    Event *events;
+    size_t count;
+    size_t cap;
+};
+
+EventStore *store_new(void)
+{
+    EventStore *s = calloc(1, sizeof(*s));
+    if (!s)
+        FATAL("Failed to allocate event store!");
+    return s;
+}
+
+/* Frees the store but not the strings of its events */
+void store_free(EventStore *s)
+{
+    free(s->events);
+    free(s);
+}
+
+size_t store_count(const EventStore *s)
+{
+    return s->count;
+}
+
+/* Returns the position of the first event whose sort key is not less
+ * than key */
+size_t store_lower_bound(const EventStore *s, uint64_t key)
+{
+    size_t lo = 0, hi = s->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (event_sort_key(s->events[mid]) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+Event *store_at(EventStore *s, size_t i)
+{
+    return i < s->count ? &s->events[i] : NULL;
+}
+
+/* Inserts e before the events at the same date and time. Files are
+ * usually loaded in order, so appending is checked for first. */
+void store_insert(EventStore *s, Event e)
+{
+    uint64_t key = event_sort_key(e);
+    size_t i = s->count;
+    if (i && event_sort_key(s->events[i - 1]) >= key)
+        i = store_lower_bound(s, key);
+
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->events = realloc(s->events, s->cap * sizeof(s->events[0]));
+        if (!s->events)
+            FATAL("Failed to allocate events!");
+    }
+    memmove(&s->events[i + 1], &s->events[i], (s->count - i) * sizeof(s->events[0]));
+    s->events[i] = e;
+    s->count++;
+}
+
+void store_remove(EventStore *s, size_t i)
+{
+    remove_element(s->events, &s->count, sizeof(s->events[0]), i);
+}
+
+/* Replaces the events of the store with n sorted events, taking
+ * ownership of the array. The events replaced are not destroyed. */
+void store_assign(EventStore *s, Event *events, size_t n)
+{
+    free(s->events);
+    s->events = events;
+    s->count = n;
+    s->cap = n;
+}
+
+StoreIter store_iter(EventStore *s, size_t i)
+{
+    return (StoreIter){s, i};
+}
+
+/* Returns the event at the iterator and moves past it, or NULL at the
+ * end */
+Event *store_next(StoreIter *it)
+{
+    EventStore *s = it->node;
+    return it->pos < s->count ? &s->events[it->pos++] : NULL;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "event.h"
+
+/* Events kept in sorted order by date and time, newer events first at
+ * the same date and time, as each is inserted before the events with
+ * an equal key. Positions are ranks in that order.
+ * Two implementations share this interface, picked when linking: a
+ * sorted array in store.c and a B+-tree in btree.c. */
+typedef struct EventStore EventStore;
+
+/* Position in a store for reading events in order. Invalidated by any
+ * change to the store. */
+typedef struct StoreIter {
+    void *node;
+    size_t pos;
+} StoreIter;
+
+EventStore *store_new(void);
+void   store_free(EventStore *s);
+size_t store_count(const EventStore *s);
+size_t store_lower_bound(const EventStore *s, uint64_t key);
+Event *store_at(EventStore *s, size_t i);
+void   store_insert(EventStore *s, Event e);
+void   store_remove(EventStore *s, size_t i);
+void   store_assign(EventStore *s, Event *events, size_t n);
+StoreIter store_iter(EventStore *s, size_t i);
+Event *store_next(StoreIter *it);
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+
+#include "common.h"
+#include "event.h"
+#include "store.h"
+
+/* Cross-checks an event store against a plain sorted array, through
+ * random inserts, removals and assignments. Link with either store. */
+
+#define ROUNDS 20000
+
+static Event random_event(uint64_t id)
+{
+    //few distinct keys, so that many events share a date and time
+    Event e = {0};
+    e.id = id;
+    e.date = rand() % 8 ? (Date){2024, 1 + rand() % 2, 1 + rand() % 28} : NULL_DATE;
+    e.time = rand() % 3 ? (Time){rand() % 3, 0} : NULL_TIME;
+    return e;
+}
+
+/* Returns the position of the first event whose sort key is not less
+ * than key */
+static size_t ref_lower_bound(Event *ref, size_t n, uint64_t key)
+{
+    size_t i = 0;
+    while (i < n && event_sort_key(ref[i]) < key)
+        i++;
+    return i;
+}
+
+static int cmp_events(const void *a, const void *b)
+{
+    uint64_t ka = event_sort_key(*(Event *)a), kb = event_sort_key(*(Event *)b);
+    return ka < kb ? -1 : ka > kb;
+}
+
+static int check(EventStore *s, Event *ref, size_t n, unsigned round)
+{
+    if (store_count(s) != n) {
+        fprintf(stderr, "Round %u: %zu events, expected %zu\n", round, store_count(s), n);
+        return -1;
+    }
+
+    StoreIter it = store_iter(s, 0);
+    for (size_t i = 0; i < n; i++) {
+        Event *e = store_next(&it);
+        if (!e || e->id != ref[i].id || store_at(s, i)->id != ref[i].id) {
+            fprintf(stderr, "Round %u: wrong event at %zu\n", round, i);
+            return -1;
+        }
+    }
+    if (store_next(&it) || store_at(s, n)) {
+        fprintf(stderr, "Round %u: events past the end\n", round);
+        return -1;
+    }
+
+    size_t i = rand() % (n + 1);
+    it = store_iter(s, i);
+    for (; i < n; i++) {
+        if (store_next(&it)->id != ref[i].id) {
+            fprintf(stderr, "Round %u: iterator wrong at %zu\n", round, i);
+            return -1;
+        }
+    }
+
+    uint64_t key = event_sort_key(random_event(0));
+    if (store_lower_bound(s, key) != ref_lower_bound(ref, n, key)) {
+        fprintf(stderr, "Round %u: lower bound of %" PRIu64 " is %zu, expected %zu\n",
+                round, key, store_lower_bound(s, key), ref_lower_bound(ref, n, key));
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+
+    EventStore *s = store_new();
+    Event *ref = NULL;
+    size_t n = 0;
+    uint64_t next_id = 1;
+    int err = 0;
+
+    for (unsigned round = 0; round < ROUNDS && !err; round++) {
+        int op = rand() % 100;
+        if (op < 60) {
+            //inserted before the events at the same date and time
+            Event e = random_event(next_id++);
+            size_t i = ref_lower_bound(ref, n, event_sort_key(e));
+            ref = add_element(ref, &n, sizeof(ref[0]), i, &e);
+            store_insert(s, e);
+        } else if (op < 99) {
+            if (n) {
+                size_t i = rand() % n;
+                remove_element(ref, &n, sizeof(ref[0]), i);
+                store_remove(s, i);
+            }
+        } else {
+            size_t count = rand() % 2000;
+            Event *events = malloc((count + 1) * sizeof(events[0]));
+            if (!events)
+                FATAL("Failed to allocate events!");
+            for (size_t i = 0; i < count; i++)
+                events[i] = random_event(next_id++);
+            qsort(events, count, sizeof(events[0]), cmp_events);
+
+            free(ref);
+            ref = malloc((count + 1) * sizeof(ref[0]));
+            if (!ref)
+                FATAL("Failed to allocate events!");
+            memcpy(ref, events, count * sizeof(ref[0]));
+            n = count;
+            store_assign(s, events, count);
+        }
+        err = check(s, ref, n, round);
+    }
+
+    store_free(s);
+    free(ref);
+    if (err)
+        return EXIT_FAILURE;
+    printf("%u rounds ok\n", ROUNDS);
+}
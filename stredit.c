@@ -5,113 +5,109 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "common.h"
+
+#define MAX_COMPLETION 256
+
 static bool OVWRT = false;
+static const Trie *const *COMPLETIONS = NULL;
+static size_t NCOMPLETIONS = 0;
 
-static inline void ensure_size(char **str, size_t *n)
+static void insert_char(GapBuf *gb, char c)
 {
-    if (strlen(*str) + 2 > *n) {
-        *n *= 2;
-        *str = realloc(*str, *n);
-    }
+    if (OVWRT)
+        gapbuf_delete_fwd(gb, 1);
+    gapbuf_insert(gb, c);
 }
 
-static void insert_char(char **str, size_t *n, char c, unsigned *i)
+static inline void backward_delete_char(GapBuf *gb)
 {
-    if (OVWRT) {
-        if (*i == strlen(*str)) {
-            ensure_size(str, n);
-            (*str)[*i + 1] = '\0';
-        }
-        (*str)[*i] = c;
-    } else {
-        ensure_size(str, n);
-        char *offset = *str + *i;
-        memmove(offset + 1, offset, strlen(offset) + 1);
-        (*str)[*i] = c;
-    }
-    (*i)++;
+    gapbuf_delete_back(gb, 1);
 }
 
-static void remove_char(char **str, size_t *n, unsigned i)
+static inline void forward_delete_char(GapBuf *gb)
 {
-    if (strlen(*str) < *n / 2) {
-        *n /= 2;
-        *str = realloc(*str, *n);
-    }
-    char *offset = *str + i + 1;
-    memmove(offset - 1, offset, strlen(offset) + 1);
+    gapbuf_delete_fwd(gb, 1);
 }
 
-static inline void backward_delete_char(char **str, size_t *n, unsigned *i)
+static unsigned forward_word(const GapBuf *gb, unsigned index)
 {
-    if (*i > 0)
-        remove_char(str, n, --*i);
+    unsigned len = gapbuf_length(gb);
+    for (; index < len && !isalnum(gapbuf_at(gb, index)); index++);
+    for (; index < len && isalnum(gapbuf_at(gb, index)); index++);
+    return index;
 }
 
-static inline void forward_delete_char(char **str, size_t *n, unsigned *i)
+static unsigned backward_word(const GapBuf *gb, unsigned index)
 {
-    if (strlen(*str) > 0)
-        remove_char(str, n, *i);
+    for (; index > 0 && !isalnum(gapbuf_at(gb, index - 1)); index--);
+    for (; index > 0 && isalnum(gapbuf_at(gb, index - 1)); index--);
+    return index;
 }
 
-static inline void forward_word(char *str, int *index)
+static inline unsigned up_line(const GapBuf *gb, unsigned index, vec2 dim)
 {
-    for (; str[*index] && !isalnum(str[*index]); (*index)++);
-    for (; str[*index] && isalnum(str[*index]); (*index)++);
+    (void)gb;
+    return index >= dim.x ? index - dim.x : index;
 }
 
-static inline void backward_word(char *str, int *index)
+static inline unsigned down_line(const GapBuf *gb, unsigned index, vec2 dim)
 {
-    for (; *index > 0 && !isalnum(str[*index - 1]); (*index)--);
-    for (; *index > 0 && isalnum(str[*index - 1]); (*index)--);
-    if (!isalnum(str[*index]) && *index > 0)
-        (*index)++;
+    return MIN(index + dim.x, gapbuf_length(gb));
 }
 
-static inline void up_line(char *str, int *index, vec2 dim)
+static void forward_delete_word(GapBuf *gb)
 {
-    (void)str;
-    if (*index - (int)dim.x >= 0)
-        *index -= dim.x;
+    unsigned index = gapbuf_cursor(gb);
+    gapbuf_delete_fwd(gb, forward_word(gb, index) - index);
 }
 
-static inline void down_line(char *str, int *index, vec2 dim)
+static void backward_delete_word(GapBuf *gb)
 {
-    if (*index + dim.x - 1 < strlen(str))
-        *index += dim.x;
-    else
-        *index = strlen(str);
+    unsigned index = gapbuf_cursor(gb);
+    gapbuf_delete_back(gb, index - backward_word(gb, index));
 }
 
-static void forward_delete_word(char **str, size_t *n, unsigned *i)
+/* Extends the word before the cursor by the characters shared by all
+ * completion candidates, adding a space if only one remains */
+static void complete_word(GapBuf *gb)
 {
-    unsigned end = *i;
-    forward_word(*str, &end);
-    unsigned diff = end - *i;
-
-    if (strlen(*str) + 1 - diff < *n / 2) {
-        *n /= 2;
-        *str = realloc(*str, *n);
+    unsigned end = gapbuf_cursor(gb);
+    unsigned start = end;
+    for (; start > 0 && !isspace(gapbuf_at(gb, start - 1)); start--);
+
+    char prefix[MAX_COMPLETION];
+    if (start == end || end - start >= sizeof(prefix)) {
+        printf("\a");
+        return;
     }
-
-    char *offset = *str + *i + diff;
-    memmove(offset - diff, offset, strlen(offset) + 1);
-}
-
-static void backward_delete_word(char **str, size_t *n, unsigned *i)
-{
-    unsigned end = *i;
-    backward_word(*str, &end);
-    unsigned diff = *i - end;
-
-    if (strlen(*str) + 1 - diff < *n / 2) {
-        *n /= 2;
-        *str = realloc(*str, *n);
+    for (unsigned i = start; i < end; i++)
+        prefix[i - start] = gapbuf_at(gb, i);
+
+    char ext[MAX_COMPLETION] = "";
+    char cand[MAX_COMPLETION];
+    size_t count = 0;
+    for (size_t i = 0; i < NCOMPLETIONS; i++) {
+        size_t n = trie_complete(COMPLETIONS[i], prefix, end - start, cand, sizeof(cand));
+        if (!n)
+            continue;
+        if (!count) {
+            strcpy(ext, cand);
+        } else {
+            unsigned j;
+            for (j = 0; ext[j] && ext[j] == cand[j]; j++);
+            ext[j] = '\0';
+        }
+        count += n;
     }
 
-    char *offset = *str + end + diff;
-    memmove(offset - diff, offset, strlen(offset) + 1);
-    *i = end;
+    for (char *c = ext; *c; c++)
+        gapbuf_insert(gb, *c);
+    end = gapbuf_cursor(gb);
+    if (count == 1 && (end == gapbuf_length(gb) || !isspace(gapbuf_at(gb, end))))
+        gapbuf_insert(gb, ' ');
+    else if (!*ext)
+        printf("\a");
 }
 
 static inline void add_wrap(vec2 *pos, vec2 dim, unsigned n)
@@ -121,81 +117,79 @@ static inline void add_wrap(vec2 *pos, vec2 dim, unsigned n)
     pos->x = ((pos->x - 1) % dim.x) + 1;
 }
 
-static inline int get_pos_from_index(char *str, vec2 start, vec2 dim,
-                                     unsigned index, vec2 *pos)
+static inline vec2 get_pos_from_index(vec2 start, vec2 dim, unsigned index)
 {
-    *pos = (vec2){start.x, start.y};
-    add_wrap(pos, dim, index);
+    vec2 pos = start;
+    add_wrap(&pos, dim, index);
+    return pos;
 }
 
-static void do_ctrl(char c, vec2 dim, vec2 start, vec2 curr,
-                    char **new_str, size_t *n, int *index)
+static void do_ctrl(char c, vec2 dim, GapBuf *gb)
 {
-    unsigned len = strlen(*new_str);
+    unsigned index = gapbuf_cursor(gb);
+    unsigned len = gapbuf_length(gb);
     if(c == '\177') { //backspace
-        if (*index > 0)
-            backward_delete_char(new_str, n, index);
+        backward_delete_char(gb);
     } else if(c == '\001') { //beginning of line
-        *index = 0;
+        gapbuf_move(gb, 0);
     } else if(c == '\002') { //left
-        if (*index - 1 >= 0)
-            (*index)--;
+        if (index > 0)
+            gapbuf_move(gb, index - 1);
     } else if(c == '\005') { //end of line
-        *index = strlen(*new_str);
+        gapbuf_move(gb, len);
     } else if(c == '\006') { //right
-        if (*index < len)
-            (*index)++;
+        gapbuf_move(gb, index + 1);
     } else if(c == '\010') { //backspace word
-        backward_delete_word(new_str, n, index);
+        backward_delete_word(gb);
+    } else if(c == '\011') { //tab completion
+        complete_word(gb);
     } else if(c == '\016') { //down
-        down_line(*new_str, index, dim);
+        gapbuf_move(gb, down_line(gb, index, dim));
     } else if(c == '\020') { //up
-        up_line(*new_str, index, dim);
+        gapbuf_move(gb, up_line(gb, index, dim));
     } else if(c == '\033') {
-        if ((c = getchar()) == '[') {
-            switch (c = getchar()) {
+        if ((c = term_getchar()) == '[') {
+            switch (c = term_getchar()) {
             case 'A': //up
-                up_line(*new_str, index, dim);
+                gapbuf_move(gb, up_line(gb, index, dim));
                 break;
             case 'B': //down
-                down_line(*new_str, index, dim);
+                gapbuf_move(gb, down_line(gb, index, dim));
                 break;
             case 'C': //right
-                if (*index < len)
-                    (*index)++;
+                gapbuf_move(gb, index + 1);
                 break;
             case 'D': //left
-                if (*index > 0)
-                    (*index)--;
+                if (index > 0)
+                    gapbuf_move(gb, index - 1);
                 break;
             case '2':
-                OVWRT = !OVWRT;
+                if (term_getchar() == '~')
+                    OVWRT = !OVWRT;
                 break;
             case '3':
-                switch (getchar()) {
+                switch (term_getchar()) {
                 case  '~':
-                    if (*index <= len) {
-                        forward_delete_char(new_str, n, index);
-                    }
+                    forward_delete_char(gb);
                     break;
                 case ';':
-                    if (getchar() == '5') {
-                        if (getchar() == '~') {
-                            forward_delete_word(new_str, n, index);
+                    if (term_getchar() == '5') {
+                        if (term_getchar() == '~') {
+                            forward_delete_word(gb);
                         }
                     }
                     break;
                 }
                 break;
             case '1':
-                if (getchar() == ';') {
-                    if (getchar() == '5') {
-                        switch (getchar()) {
+                if (term_getchar() == ';') {
+                    if (term_getchar() == '5') {
+                        switch (term_getchar()) {
                         case 'C': //right by word
-                            forward_word(*new_str, index);
+                            gapbuf_move(gb, forward_word(gb, index));
                             break;
                         case 'D': //left by word
-                            backward_word(*new_str, index);
+                            gapbuf_move(gb, backward_word(gb, index));
                             break;
                         }
                     }
@@ -206,61 +200,193 @@ static void do_ctrl(char c, vec2 dim, vec2 start, vec2 curr,
     }
 }
 
-char *stredit(const char *str)
+static inline void print_range(const GapBuf *gb, unsigned from, unsigned to)
+{
+    if (to > from)
+        gapbuf_fwrite(gb, from, to, stdout);
+}
+
+/* Prints the string on screen rows top through bottom, given the
+ * position it starts at, and clears what is past its end */
+static void draw_rows(const GapBuf *gb, vec2 start, vec2 dim, int top, int bottom)
+{
+    unsigned len = gapbuf_length(gb);
+    unsigned offset = start.x - 1;
+    for (int y = MAX(top, (int)start.y); y <= bottom; y++) {
+        unsigned r = y - (int)start.y;
+        unsigned rs = r ? r * dim.x - offset : 0;
+        unsigned re = (r + 1) * dim.x - offset;
+        set_cursor_pos((vec2){r ? 1 : start.x, y});
+        print_range(gb, MIN(rs, len), MIN(re, len));
+        if (re > len)
+            printf("\033[K");
+    }
+}
+
+/* Scrolls the string so that the row holding index is on screen,
+ * printing only the rows brought into view. Scrolling up moves the
+ * terminal along, so what was printed above the string goes with it. */
+static void scroll_to(const GapBuf *gb, vec2 *start, vec2 dim, unsigned index)
+{
+    int rows = dim.y;
+    int y = get_pos_from_index(*start, dim, index).y;
+    if (y > rows) {
+        int n = MIN(y - rows, rows);
+        set_cursor_pos((vec2){1, dim.y});
+        for (int i = 0; i < n; i++)
+            printf("\n");
+        start->y -= y - rows;
+        draw_rows(gb, *start, dim, rows - n + 1, rows);
+    } else if (y < 1) {
+        int n = MIN(1 - y, rows);
+        set_cursor_pos((vec2){1, 1});
+        printf("\033[%dL", n);
+        start->y += 1 - y;
+        draw_rows(gb, *start, dim, 1, n);
+    }
+}
+
+/* Reprints the rows of the string on screen, first scrolling it so that
+ * the row holding index is */
+static void redraw_all(const GapBuf *gb, vec2 *start, vec2 dim, unsigned index)
+{
+    scroll_to(gb, start, dim, index);
+    draw_rows(gb, *start, dim, 1, dim.y);
+}
+
+/* Updates the screen after the string changed at index from and its
+ * length went from old_len to len. Text already on screen is shifted
+ * with insert/delete character sequences, so only the changed
+ * characters and the few which wrap between rows are printed. */
+static void redraw_region(const GapBuf *gb, unsigned old_len,
+                          unsigned from, vec2 start, vec2 dim)
+{
+    unsigned len = gapbuf_length(gb);
+    unsigned offset = start.x - 1;
+    unsigned w = dim.x;
+
+    if (len == old_len) { //overwrite
+        if (from < len) {
+            set_cursor_pos((vec2){(offset + from) % w + 1, start.y + (offset + from) / w});
+            print_range(gb, from, from + 1);
+        }
+        return;
+    }
+
+    unsigned k = len > old_len ? len - old_len : old_len - len;
+    unsigned end = MAX(len, old_len);
+    for (unsigned r = (offset + from) / w; r * w < offset + end; r++) {
+        unsigned rs = r * w > offset ? r * w - offset : 0;
+        unsigned re = (r + 1) * w - offset;
+        unsigned a = MAX(from, rs);
+        unsigned y = start.y + r;
+
+        if ((int)y < 1)
+            continue;
+        if (y > dim.y)
+            break;
+
+        set_cursor_pos((vec2){(offset + a) % w + 1, y});
+        if (len > old_len && k < re - a) {
+            printf("\033[%u@", k);
+            print_range(gb, a, MIN(a + k, len));
+        } else if (len < old_len && k < re - a) {
+            printf("\033[%uP", k);
+            if (re - k < len) {
+                set_cursor_pos((vec2){(offset + re - k) % w + 1, y});
+                print_range(gb, re - k, MIN(re, len));
+            }
+        } else {
+            print_range(gb, a, MIN(re, len));
+            if (re > len)
+                printf("\033[K");
+        }
+    }
+}
+
+/* Edits the contents of gb in place on the terminal until return is
+ * pressed. The buffer may be reused across calls to avoid
+ * reallocating for every prompt. Returns 0, or EOF at the end of input
+ * or on Ctrl-D while the string is empty. */
+int stredit_buf(GapBuf *gb)
 {
     vec2 start_pos, curr_pos, dim;
-    int index = 0;
-    unsigned len = 0;
-    size_t n = 2 * (str ? (strlen(str) + 1) : 1);
-    char *new_str = malloc(n);
-    if (str)
-        strcpy(new_str, str);
-    else
-        strcpy(new_str, "");
+    unsigned len = gapbuf_length(gb);
 
     start_noncannon();
     start_pos = get_cursor_pos();
     dim = get_term_size();
 
+    gapbuf_move(gb, 0);
+    redraw_all(gb, &start_pos, dim, 0);
     curr_pos = start_pos;
-    if (str)
-        printf("%s", str);
     set_cursor_pos(curr_pos);
 
-    char c;
+    int ret = 0;
     for (;;) {
+        int c = term_getchar();
+        if (c == '\n')
+            break;
+        if (c == EOF || (c == '\004' && !len)) {
+            ret = EOF;
+            break;
+        }
+
+        vec2 old_dim = dim;
         dim = get_term_size();
+        bool resized = old_dim.x != dim.x || old_dim.y != dim.y;
         if (start_pos.x > dim.x) {
             add_wrap(&start_pos, dim, 0);
         }
 
-        c = getchar();
-        if (c == '\n')
-            break;
-
-        if (c >= ' ' && c <= '~')
-            insert_char(&new_str, &n, c, &index);
+        unsigned old_len = len;
+        unsigned old_index = gapbuf_cursor(gb);
+        bool printable = c >= ' ' && c <= '~';
+        if (printable)
+            insert_char(gb, c);
         else
-            do_ctrl(c, dim, start_pos, curr_pos, &new_str, &n, &index);
-
-        vec2 end_pos;
-        get_pos_from_index(new_str, start_pos, dim, strlen(new_str), &end_pos);
-        set_cursor_pos(start_pos);
-        printf("%s \033[K", new_str);
-        if (end_pos.y > dim.y) {
-            start_pos.y--;
-            end_pos.y--;
+            do_ctrl(c, dim, gb);
+        len = gapbuf_length(gb);
+        unsigned index = gapbuf_cursor(gb);
+
+        //the edit is drawn first, leaving out rows off screen, so those
+        //a scroll brings into view are printed once and already changed
+        if (resized) {
+            redraw_all(gb, &start_pos, dim, index);
+        } else {
+            if (len != old_len || (printable && OVWRT))
+                redraw_region(gb, old_len, MIN(index, old_index), start_pos, dim);
+            scroll_to(gb, &start_pos, dim, index);
         }
-        set_cursor_pos(end_pos);
-        if (end_pos.y <= dim.y)
-            printf("\033[K");
-        get_pos_from_index(new_str, start_pos, dim, index, &curr_pos);
-        set_cursor_pos(curr_pos);
 
+        curr_pos = get_pos_from_index(start_pos, dim, index);
+        set_cursor_pos(curr_pos);
     }
+
+    //leave the cursor past the end, so output follows the string
+    scroll_to(gb, &start_pos, dim, len);
+    set_cursor_pos(get_pos_from_index(start_pos, dim, len));
     printf("\n");
     end_noncannon();
-    return new_str;
+    return ret;
+}
+
+/* Sets the words offered for tab completion. The tries must outlive
+ * any following calls to stredit. */
+void stredit_set_completion(const Trie *const *tries, size_t n)
+{
+    COMPLETIONS = tries;
+    NCOMPLETIONS = n;
+}
+
+char *stredit(const char *str) //allocates new string
+{
+    GapBuf gb;
+    gapbuf_init(&gb, str);
+    stredit_buf(&gb);
+    char *ret = gapbuf_to_str(&gb);
+    gapbuf_destroy(&gb);
+    return ret;
 }
 
 /* int main(int argc, char **argv) */
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "gapbuf.h"
 #include "termanip.h"
+#include "trie.h"
 
 char *stredit(const char *str);
+int   stredit_buf(GapBuf *gb);
+void  stredit_set_completion(const Trie *const *tries, size_t n);
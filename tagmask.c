@@ -0,0 +1,85 @@
+#include "tagmask.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "common.h"
+#include "idmap.h"
+
+static IdMap ids;                   //hash of a tag to its bit
+static char *names[TAGMASK_BITS];  //tag of each bit
+static int nnames;
+
+static uint64_t hash_tag(const char *tag)
+{
+    uint64_t h = hash_bytes(tag, strlen(tag), 0);
+    return h ? h : 1;
+}
+
+/* Returns the bit of tag, giving it the next free one if it has none.
+ * Returns -1 once every bit is taken, or if tag's hash collides with
+ * that of another tag. */
+int tag_intern(const char *tag)
+{
+    uint64_t h = hash_tag(tag);
+    size_t bit;
+    if (idmap_get(&ids, h, &bit))
+        return strcmp(names[bit], tag) ? -1 : (int)bit;
+    if (nnames == TAGMASK_BITS)
+        return -1;
+
+    names[nnames] = str_dup(tag);
+    idmap_set(&ids, h, nnames);
+    return nnames++;
+}
+
+/* Returns the bit of tag, or -1 if it has none */
+int tag_lookup(const char *tag)
+{
+    size_t bit;
+    if (!idmap_get(&ids, hash_tag(tag), &bit) || strcmp(names[bit], tag))
+        return -1;
+    return bit;
+}
+
+void tagmask_clear(TagMask *m)
+{
+    *m = (TagMask){{0}};
+}
+
+void tagmask_set(TagMask *m, int bit)
+{
+    m->w[bit / 64] |= (uint64_t)1 << bit % 64;
+}
+
+void tagmask_unset(TagMask *m, int bit)
+{
+    m->w[bit / 64] &= ~((uint64_t)1 << bit % 64);
+}
+
+bool tagmask_test(const TagMask *m, int bit)
+{
+    return m->w[bit / 64] >> bit % 64 & 1;
+}
+
+/* Whether m has every bit of all and none of the bits of none */
+bool tagmask_match(const TagMask *m, const TagMask *all, const TagMask *none)
+{
+#ifdef __SSE2__
+    __m128i miss = _mm_setzero_si128();
+    for (unsigned i = 0; i < TAGMASK_WORDS; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&m->w[i]);
+        __m128i a = _mm_loadu_si128((const __m128i *)&all->w[i]);
+        __m128i n = _mm_loadu_si128((const __m128i *)&none->w[i]);
+        miss = _mm_or_si128(miss, _mm_andnot_si128(v, a));
+        miss = _mm_or_si128(miss, _mm_and_si128(v, n));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(miss, _mm_setzero_si128())) == 0xFFFF;
+#else
+    uint64_t miss = 0;
+    for (unsigned i = 0; i < TAGMASK_WORDS; i++)
+        miss |= (all->w[i] & ~m->w[i]) | (m->w[i] & none->w[i]);
+    return !miss;
+#endif
+}
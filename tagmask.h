@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TAGMASK_WORDS 4
+#define TAGMASK_BITS (64 * TAGMASK_WORDS)
+
+/* Bitset of interned tags. The first TAGMASK_BITS distinct tags seen by
+ * the process are given a bit; rarer tags have none and are only found
+ * in an event's tag list. */
+typedef struct TagMask {
+    uint64_t w[TAGMASK_WORDS];
+} TagMask;
+
+int  tag_intern(const char *tag);
+int  tag_lookup(const char *tag);
+
+void tagmask_clear(TagMask *m);
+void tagmask_set(TagMask *m, int bit);
+void tagmask_unset(TagMask *m, int bit);
+bool tagmask_test(const TagMask *m, int bit);
+bool tagmask_match(const TagMask *m, const TagMask *all, const TagMask *none);
@@ -1,12 +1,49 @@
+#define _DEFAULT_SOURCE
+
 #include "termanip.h"
 
 #include <termios.h>
 #include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 
 #include "common.h"
 
 static struct termios old, new;
 
+/* Terminal size is cached and only refreshed after SIGWINCH. Cursor
+ * position is tracked through set_cursor_pos while in noncannonical
+ * mode, so the terminal is queried at most once per edit. */
+static volatile sig_atomic_t size_stale = true;
+static vec2 term_size;
+static bool cursor_known = false;
+static vec2 cursor;
+
+/* Keys typed while waiting for a cursor position report */
+static char typeahead[64];
+static size_t ntypeahead = 0;
+static size_t typeahead_pos = 0;
+
+static void handle_winch(int sig)
+{
+    (void)sig;
+    size_stale = true;
+}
+
+static void watch_resize(void)
+{
+    static bool installed = false;
+    if (!installed) {
+        struct sigaction sa = {0};
+        sa.sa_handler = handle_winch;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGWINCH, &sa, NULL);
+        installed = true;
+    }
+}
+
 void start_noncannon(void)
 {
     tcgetattr(0, &old);
@@ -19,22 +56,46 @@ void start_noncannon(void)
 void end_noncannon(void)
 {
     tcsetattr(0, TCSANOW, &old);
+    cursor_known = false;
 }
 
 void set_cursor_pos(vec2 p)
 {
     printf("\033[%u;%uH", p.y, p.x);
+    cursor = p;
+    cursor_known = true;
+}
+
+bool term_has_typeahead(void)
+{
+    return typeahead_pos < ntypeahead;
+}
+
+/* Reads a key, returning any typed ahead of a position report first */
+int term_getchar(void)
+{
+    if (typeahead_pos < ntypeahead)
+        return (unsigned char)typeahead[typeahead_pos++];
+    ntypeahead = typeahead_pos = 0;
+    return getchar();
 }
 
+/* Reads a cursor position report into resp, keeping keys typed before
+ * it. Returns 1 once read, 0 on a malformed report and -1 at EOF. */
 int try_read_pos(char *resp, size_t *n)
 {
-    char c;
-    while ((c = getchar()) != '\033');
+    int c;
+    while ((c = getchar()) != '\033') {
+        if (c == EOF)
+            return -1;
+        if (ntypeahead < sizeof(typeahead))
+            typeahead[ntypeahead++] = c;
+    }
     if ((c = getchar()) != '[')
-        return 0;
+        return c == EOF ? -1 : 0;
     while ((c = getchar()) != ';') {
         if (!isdigit(c))
-            return 0;
+            return c == EOF ? -1 : 0;
         else {
             resp[(*n)++] = c;
             if (*n > 64)
@@ -48,7 +109,7 @@ int try_read_pos(char *resp, size_t *n)
 
     while ((c = getchar()) != 'R') {
         if (!isdigit(c))
-            return 0;
+            return c == EOF ? -1 : 0;
         else {
             resp[(*n)++] = c;
             if (*n > 64)
@@ -59,24 +120,50 @@ int try_read_pos(char *resp, size_t *n)
     return 1;
 }
 
+/* Returns where the cursor is, or the top left corner if the terminal
+ * is gone, in which case the next key read is EOF */
 vec2 get_cursor_pos(void)
 {
-    vec2 p;
+    if (cursor_known && !size_stale)
+        return cursor;
+
+    vec2 p = {1, 1};
     size_t n = 0;
     char resp[65] = "";
+    int got;
     printf("\033[6n");
-    while (!try_read_pos(resp, &n));
-    sscanf(resp, "%u;%u", &p.y, &p.x);
+    while (!(got = try_read_pos(resp, &n)));
+    if (got == 1)
+        sscanf(resp, "%u;%u", &p.y, &p.x);
+    cursor = p;
+    cursor_known = true;
     return p;
 }
 
-vec2 get_term_size(void)
+static vec2 query_term_size(void)
 {
-    vec2 s;
+    vec2 s = {80, 24};
     size_t n = 0;
     char resp[65] = "";
+    int got;
     printf("\033[s\033[999;999H\033[6n\033[u");
-    while (!try_read_pos(resp, &n));
-    sscanf(resp, "%u;%u", &s.y, &s.x);
+    while (!(got = try_read_pos(resp, &n)));
+    if (got == 1)
+        sscanf(resp, "%u;%u", &s.y, &s.x);
     return s;
 }
+
+vec2 get_term_size(void)
+{
+    watch_resize();
+    if (size_stale) {
+        size_stale = false;
+        cursor_known = false;
+        struct winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != -1 && ws.ws_col > 0 && ws.ws_row > 0)
+            term_size = (vec2){ws.ws_col, ws.ws_row};
+        else
+            term_size = query_term_size();
+    }
+    return term_size;
+}
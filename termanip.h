@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 
 typedef struct vec2 {
@@ -19,6 +20,8 @@ static inline vec2 vec2_add(vec2 v1, vec2 v2)
 void start_noncannon(void);
 void end_noncannon(void);
 void set_cursor_pos(vec2 p);
+int term_getchar(void);
+bool term_has_typeahead(void);
 int try_read_pos(char *resp, size_t *n);
 vec2 get_cursor_pos(void);
 vec2 get_term_size(void);
@@ -13,7 +13,10 @@ int main(int argc, char **argv)
         FATAL("Failed to open file \"%s\"\n", argv[1]);
 
     Database db;
-    if (database_load(&db, f) != -1) {
-        event_print_arr(db.events, db.count, PRINT_ALL);
+    Event *events;
+    size_t n;
+    if (database_load(&db, f) != -1 && database_query_all(&db, &events, &n) != -1) {
+        event_print_arr(events, n, PRINT_ALL);
+        free(events);
     }
 }
@@ -1,14 +1,28 @@
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/stat.h>
 
+#include "command.h"
 #include "common.h"
 #include "database.h"
+#include "diff.h"
+#include "ics.h"
+#include "pager.h"
+#include "query.h"
 #include "stredit.h"
+#include "watch.h"
+#include "wheel.h"
 
 /* Error messages */
 #define BAD_IN_FRMT_SPEC "%s \"%s\"\n"
@@ -16,20 +30,61 @@ static const char *INC_SPEC = "Incomplete specifier";
 static const char *UNRC_TOK = "Unrecognised token";
 static const char *INV_DATE = "Invalid date";
 static const char *INV_TIME = "Invalid time";
+static const char *INV_DRTN = "Invalid duration";
 static const char *INV_PRTY = "Invalid priority";
+static const char *INV_RECR = "Invalid recurrence";
 static const char *INV_SELN = "Invalid selection";
 static const char *BAD_ARG = "Bad argument";
 static const char *EXTR_TXT = "Extraneous text";
 static const char *RQRS_ARG = "Must provide argument";
 
+#define AGENDA_LEN 10 //events listed by agenda unless told otherwise
+#define REMIND_AHEAD DAY_MINUTES //of reminders held ahead of the current minute
+#define AUTOSAVE_SECS 60 //before unsaved changes are saved, unless told otherwise
+
+/* Words offered for tab completion besides commands, day names and tags */
+static const char *KEYWORDS[] = {
+    "today", "tomorrow", "yesterday", "last", "this", "next"
+};
+
+/* Database file of the interactive session, reloaded when changed */
+static FileWatch watch = {-1, -1};
+
+/* Save of a snapshot of the database, written by a thread of its own so
+ * the prompt never waits on the disk */
+typedef struct SaveJob {
+    bool running;
+    bool again;          //save once more when done, as asked to meanwhile
+    pthread_t thread;
+    DbSnapshot snap;
+    char *filepath;
+    bool other;          //filepath is not the file the database was loaded from
+    int status;          //0 once written, -1 on failure, 1 if another
+                         //process saved the file first
+    uint64_t generation; //of the file as found
+    struct stat written; //of the file as written, while still locked
+    int done[2];         //pipe written to by the thread when it finishes
+} SaveJob;
+
+static SaveJob job = {.done = {-1, -1}};
+
+/* Seconds changes go unsaved for before being saved, 0 for never */
+static unsigned autosave_secs = AUTOSAVE_SECS;
+static time_t unsaved_since; //when the database was first seen modified
+
+/* Today's date as of the command being run, NULL_DATE until asked for */
+static Date current_date = {-1, -1, -1};
+
 static Date get_current_date()
 {
+    if (!date_is_null(current_date))
+        return current_date;
+
     time_t t = time(NULL);
     struct tm *time = localtime(&t);
     if (time != NULL)
-        return (Date){time->tm_year + 1900, time->tm_mon + 1, time->tm_mday};
-    else
-        return NULL_DATE;
+        current_date = (Date){time->tm_year + 1900, time->tm_mon + 1, time->tm_mday};
+    return current_date;
 }
 
 static Time get_current_time()
@@ -127,11 +182,11 @@ static Date get_date_from_toks(char **line)
         int offset = str2dayofweek(tok) - date_day_of_week(today);
         offset = offset < 0 ? offset + 7 : offset;
         date = date_add_days(today, offset);
-    } else if(!date_is_null(date = date_from_str(tok))) { //numeric date
-        if (!date_validate(date)) {
+    } else if (strchr(tok, '/')) { //numeric date
+        date = date_from_str(tok);
+        if (date_is_null(date)) {
             fprintf(stderr, BAD_IN_FRMT_SPEC, INV_DATE, tok);
             *line = NULL;
-            date = NULL_DATE;
         }
     }
 
@@ -150,53 +205,374 @@ static inline bool file_exists(const char *filename)
     return !(stat(filename, &s) == -1 && errno == ENOENT);
 }
 
+/* Takes an advisory lock of the given type on the database file,
+ * waiting for other processes to release theirs. The lock is taken on
+ * filepath.lock, as saving replaces the file itself. Returns the
+ * descriptor to pass to unlock_file, or -1 if locking isn't possible. */
+static int lock_file(const char *filepath, short type)
+{
+    char *lockpath = malloc(strlen(filepath) + 6);
+    strcpy(lockpath, filepath);
+    strcat(lockpath, ".lock");
+    int fd = open(lockpath, O_RDWR | O_CREAT, 0644);
+    free(lockpath);
+    if (fd == -1)
+        return -1;
+
+    struct flock fl = {0};
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &fl) == -1) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static void unlock_file(int fd)
+{
+    if (fd != -1)
+        close(fd);
+}
+
+/* Returns the generation in the header of the file, 0 if it has none */
+static uint64_t file_generation(const char *filepath)
+{
+    FILE *f = fopen(filepath, "r");
+    if (!f)
+        return 0;
+
+    DbReader r;
+    database_reader_init(&r, f);
+    database_reader_header(&r);
+    uint64_t generation = r.generation;
+    database_reader_destroy(&r);
+    fclose(f);
+    return generation;
+}
+
 /* Saves database to file, renaming existing file to filepath~ */
 static int load(Database *db, char *filepath)
 {
+    int lock = lock_file(filepath, F_RDLCK);
     if (!file_exists(filepath)) {
         fclose(fopen(filepath, "w"));
         database_init(db);
     } else {
         FILE *f = fopen(filepath, "r");
-        if (!f)
+        if (!f) {
+            unlock_file(lock);
             return -1;
+        }
 
-        if (database_load(db, f) == -1)
+        if (database_load(db, f) == -1) {
+            unlock_file(lock);
             return -2;
+        }
 
         fclose(f);
     }
+    unlock_file(lock);
 
+    watch_sync(&watch, filepath);
     return 0;
 }
 
-/* Saves database to file, renaming existing file to filepath~ */
-static int save(Database *db, char *filepath)
+static void report_diff(void *data, DiffKind kind, Event *old, Event *new)
 {
-    char *backup = malloc(strlen(filepath) + 2);
-    strcpy(backup, filepath);
-    strcat(backup, "~");
+    size_t *count = data;
+    (*count)++;
+    diff_print(kind, old, new);
+}
 
-    if (rename(filepath, backup) == -1) {
-        if (errno != ENOENT) {
-            free(backup);
-            return -1;
-        }
+/* Prints the changes from the events of src to those of the file at
+ * filepath, reading the file one event at a time */
+static int diff_file(DiffSource src, const char *filepath)
+{
+    FILE *f = fopen(filepath, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open file \"%s\"\n", filepath);
+        return -1;
+    }
+
+    DbReader r;
+    database_reader_init(&r, f);
+    size_t count = 0;
+    int err = diff_events(src, diff_source_file(&r), report_diff, &count);
+    database_reader_destroy(&r);
+    fclose(f);
+
+    if (err != -1 && !count)
+        printf("No differences\n");
+    return err;
+}
+
+/* Prints the changes from the file at path_a to the one at path_b */
+static int diff_files(const char *path_a, const char *path_b)
+{
+    FILE *f = fopen(path_a, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open file \"%s\"\n", path_a);
+        return -1;
+    }
+
+    DbReader r;
+    database_reader_init(&r, f);
+    int err = diff_file(diff_source_file(&r), path_b);
+    database_reader_destroy(&r);
+    fclose(f);
+    return err;
+}
+
+static void report_conflict(void *data, DiffKind kind, Event *old, Event *new)
+{
+    size_t *count = data;
+    (*count)++;
+    PRTESC(BOLD);
+    printf("Changed both here and in file, keeping unsaved version:\n");
+    PRTESC(RESET);
+    diff_print(kind, old, new);
+}
+
+/* Applies changes made to the database file by another process. The
+ * caller holds the lock. */
+static int apply_changes(Database *db, const char *filepath)
+{
+    FILE *f = fopen(filepath, "r");
+    if (!f)
+        return -1;
+
+    DbReader r;
+    database_reader_init(&r, f);
+    size_t conflicts = 0;
+    int applied = diff_apply(db, &r, report_conflict, &conflicts);
+    database_reader_destroy(&r);
+    fclose(f);
+
+    if (applied == -1) {
+        fprintf(stderr, "Failed to reload \"%s\"\n", filepath);
+        return -1;
+    } else if (applied || conflicts) {
+        printf("Reloaded \"%s\": %d change%s applied", filepath, applied, applied == 1 ? "" : "s");
+        if (conflicts)
+            printf(", %zu conflict%s", conflicts, conflicts == 1 ? "" : "s");
+        printf("\n");
     }
+    return 0;
+}
+
+static int reload(Database *db, const char *filepath)
+{
+    int lock = lock_file(filepath, F_RDLCK);
+    int err = apply_changes(db, filepath);
+    unlock_file(lock);
+    return err;
+}
+
+/* Writes the snapshot of the job to its file, renaming the existing file
+ * to filepath~. The caller holds the lock. Returns the job's status. */
+static int write_snapshot(SaveJob *j)
+{
+    //another process saved since this database was loaded or saved, so
+    //its changes are to be brought in rather than overwritten
+    j->generation = file_generation(j->filepath);
+    if (!j->other && file_exists(j->filepath) && j->generation != j->snap.generation - 1)
+        return 1;
+    j->snap.generation = j->generation + 1;
+
+    char *backup = malloc(strlen(j->filepath) + 2);
+    strcpy(backup, j->filepath);
+    strcat(backup, "~");
+    int err = rename(j->filepath, backup);
     free(backup);
+    if (err == -1 && errno != ENOENT)
+        return -1;
 
-    FILE *f = fopen(filepath, "w");
-    if (f) {
-        if (database_save(db, f) == -1) {
-            return -1;
-        }
-        fclose(f);
+    FILE *f = fopen(j->filepath, "w");
+    if (!f)
+        return -1;
+    err = database_save_snapshot(&j->snap, f);
+    //another process may replace the file as soon as it is unlocked
+    if (fflush(f) == EOF || fstat(fileno(f), &j->written) == -1)
+        err = -1;
+    if (fclose(f) == EOF)
+        err = -1;
+    return err;
+}
+
+/* Runs on the job's thread, touching nothing but the job */
+static void *save_thread(void *data)
+{
+    SaveJob *j = data;
+    int lock = lock_file(j->filepath, F_WRLCK);
+    j->status = write_snapshot(j);
+    unlock_file(lock);
+
+    char byte = 0;
+    while (write(j->done[1], &byte, 1) == -1 && errno == EINTR);
+    return NULL;
+}
+
+/* Starts saving database to file in the background. Only the snapshot,
+ * taken here, is read by the thread, so the database may change
+ * meanwhile. other is set when filepath is not the file the database was
+ * loaded from, which is then replaced rather than merged with. */
+static int start_save(Database *db, const char *filepath, bool other)
+{
+    if (job.running) {
+        job.again = true;
+        return 0;
+    }
+    if (job.done[0] == -1 && pipe(job.done) == -1)
+        return -1;
+
+    database_snapshot(db, &job.snap);
+    job.filepath = str_dup(filepath);
+    job.other = other;
+    if (pthread_create(&job.thread, NULL, save_thread, &job)) {
+        database_release(db, &job.snap, false);
+        free(job.filepath);
+        return -1;
+    }
+    job.running = true;
+    unsaved_since = 0;
+    return 0;
+}
+
+/* Moves off the prompt to print a message if waiting at it */
+static void leave_prompt(bool prompt)
+{
+    if (prompt) {
+        printf("\n");
+        PRTESC(RESET);
+    }
+}
+
+static void restore_prompt(bool prompt)
+{
+    if (prompt) {
+        PRTESC(BOLD BLU);
+        printf("> ");
+        fflush(stdout);
     }
+}
+
+/* Collects the background save if it has finished, or waits for it if
+ * wait is set. When another process saved the file first, its changes
+ * are merged in and the save starts over. prompt is set when waiting at
+ * the prompt. Returns -1 if the save failed. */
+static int finish_save(Database *db, bool wait, bool prompt)
+{
+    while (job.running) {
+        char byte;
+        struct pollfd fd = {job.done[0], POLLIN};
+        if (!wait && poll(&fd, 1, 0) < 1)
+            return 0;
+        while (read(job.done[0], &byte, 1) == -1 && errno == EINTR);
+        pthread_join(job.thread, NULL);
+        job.running = false;
+
+        int status = job.status;
+        char *filepath = job.filepath;
+        database_release(db, &job.snap, status == 0);
+        if (status == 0) {
+            watch_sync_stat(&watch, filepath, &job.written);
+        } else {
+            leave_prompt(prompt);
+            if (status == 1) {
+                printf("\"%s\" was saved by another process, merging its changes\n", filepath);
+                if (reload(db, filepath) == -1)
+                    status = -1;
+                else
+                    db->generation = job.generation;
+            }
+            if (status == -1 && job.other)
+                fprintf(stderr, "Failed to save database to file \"%s\"\n", filepath);
+            else if (status == -1)
+                fprintf(stderr, "Failed to save database\n");
+            restore_prompt(prompt);
+        }
 
+        bool again = job.again || status == 1;
+        job.again = false;
+        if (again && database_is_modified(db) && start_save(db, filepath, job.other) == -1)
+            status = -1;
+        free(filepath);
+        if (status == -1)
+            return -1;
+    }
     return 0;
 }
 
-/* Sets *e to event with given date, time, and index */
+/* Saves database to file, waiting for it to be written */
+static int save(Database *db, char *filepath, bool other)
+{
+    finish_save(db, true, false);
+    if (start_save(db, filepath, other) == -1)
+        return -1;
+    return finish_save(db, true, false);
+}
+
+/* Starts saving in the background once changes have gone unsaved for
+ * autosave_secs */
+static void autosave(Database *db, const char *filepath)
+{
+    if (!database_is_modified(db))
+        unsaved_since = 0;
+    if (!autosave_secs || job.running || !database_is_modified(db))
+        return;
+
+    time_t now = time(NULL);
+    if (!unsaved_since)
+        unsaved_since = now;
+    if (now - unsaved_since >= autosave_secs)
+        start_save(db, filepath, false);
+}
+
+/* Milliseconds until autosave is due, or -1 if it isn't */
+static int autosave_timeout(Database *db)
+{
+    if (!autosave_secs || job.running || !unsaved_since || !database_is_modified(db))
+        return -1;
+    time_t left = unsaved_since + autosave_secs - time(NULL);
+    return left > 0 ? left * 1000 : 0;
+}
+
+/* Waits for the first key of a command, reloading the database whenever
+ * its file changes meanwhile, and saving it when autosave is due */
+static void wait_for_input(Database *db, const char *filepath)
+{
+    struct pollfd fds[] = {{STDIN_FILENO, POLLIN}, {-1, POLLIN}, {-1, POLLIN}};
+    for (;;) {
+        if (term_has_typeahead())
+            return;
+
+        //the file is left alone while being saved, as the save changes it
+        fds[1].fd = job.running ? -1 : watch.fd;
+        fds[2].fd = job.running ? job.done[0] : -1;
+
+        start_noncannon();
+        int ready = poll(fds, COUNTOF(fds), autosave_timeout(db));
+        end_noncannon();
+        if (ready == -1 && errno != EINTR)
+            return;
+        if (fds[0].revents)
+            return;
+
+        if (fds[2].revents) {
+            finish_save(db, false, true);
+        } else if (fds[1].revents && watch_changed(&watch)) {
+            leave_prompt(true);
+            reload(db, filepath);
+            restore_prompt(true);
+        }
+        autosave(db, filepath);
+    }
+}
+
+/* Sets *e to event with given date, time, and index, or with given #id */
 static int select_event(Database *db, char **line, Event *e)
 {
     char *tok;
@@ -205,6 +581,26 @@ static int select_event(Database *db, char **line, Event *e)
     int err = -1;
     int which = -1;
 
+    if (**line == '#') {
+        tok = next_tok(line);
+
+        char *endptr;
+        uint64_t id = strtoull(tok + 1, &endptr, 10);
+        Event *found = NULL;
+        if (*endptr != '\0' || endptr == tok + 1 || !(found = database_get_event(db, id))) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, INV_SELN, tok);
+        } else if (**line != '\0') {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, *line);
+            found = NULL;
+        }
+
+        free(tok);
+        if (!found)
+            return -1;
+        *e = *found;
+        return 0;
+    }
+
     Date d = get_date_from_toks(line);
     if (date_is_null(d)) {
         //print bad arg msg is line doesn't contain date
@@ -304,19 +700,20 @@ static int get_ync(char *msg)
 /* Prompts user for data on new event */
 static int edit_event_prompt(Event *e)
 {
-    size_t size = 0;
-    char *line = NULL;
+    GapBuf gb;
     char *remaining, *tok;
 
+    gapbuf_init(&gb, NULL);
+
     for (;;) {
-        free(line);
         PRTESC(BOLD BLU);
         printf("Edit date:\n");
         PRTESC(RESET);
         char *date = date_to_str(e->date);
-        line = stredit(date);
+        gapbuf_set(&gb, date);
         free(date);
-        remaining = line;
+        stredit_buf(&gb);
+        remaining = gapbuf_str(&gb);
         Date d = get_date_from_toks(&remaining);
         if (date_is_null(d)) {
             if (remaining)
@@ -332,14 +729,14 @@ static int edit_event_prompt(Event *e)
     }
 
     for (;;) {
-        free(line);
         PRTESC(BOLD BLU);
         printf("Edit time:\n");
         PRTESC(RESET);
         char *time = time_to_str(e->time);
-        line = stredit(time);
+        gapbuf_set(&gb, time);
         free(time);
-        remaining = line;
+        stredit_buf(&gb);
+        remaining = gapbuf_str(&gb);
         for (; isspace(*remaining) && *remaining; remaining++);
         if (!*remaining)
             break;
@@ -362,14 +759,38 @@ static int edit_event_prompt(Event *e)
         }
     }
 
+    while (!time_is_null(e->time)) {
+        PRTESC(BOLD BLU);
+        printf("Edit duration (e.g. 45m, 1h30m, none):\n");
+        PRTESC(RESET);
+        char duration[DURATION_STR_LEN] = "none";
+        if (e->duration)
+            duration_format(e->duration, duration);
+        gapbuf_set(&gb, duration);
+        stredit_buf(&gb);
+        remaining = gapbuf_str(&gb);
+        for (; isspace(*remaining) && *remaining; remaining++);
+        if (!*remaining || !strcmp(remaining, "none")) {
+            event_set_duration(e, 0);
+            break;
+        }
+        int minutes = duration_from_str(remaining);
+        if (minutes == -1) {
+            printf(BAD_IN_FRMT_SPEC, INV_DRTN, remaining);
+            continue;
+        }
+        event_set_duration(e, minutes);
+        break;
+    }
+
     for (;;) {
-        free(line);
         PRTESC(BOLD BLU);
         printf("Edit priority (Low, Medium, High, Urgent):\n");
         PRTESC(RESET);
         const char *prio = priority_to_str(e->priority);
-        line = stredit(prio);
-        remaining = line;
+        gapbuf_set(&gb, prio);
+        stredit_buf(&gb);
+        remaining = gapbuf_str(&gb);
         for (; isspace(*remaining) && *remaining; remaining++);
         if (!*remaining)
             break;
@@ -392,36 +813,54 @@ static int edit_event_prompt(Event *e)
         }
     }
 
-    free(line);
     PRTESC(BOLD BLU);
     printf("Edit subject:\n");
     PRTESC(RESET);
-    line = stredit(e->subject);
-    remaining = line;
+    gapbuf_set(&gb, e->subject);
+    stredit_buf(&gb);
+    remaining = gapbuf_str(&gb);
     for (; isspace(*remaining) && *remaining; remaining++);
     if (*remaining)
         event_set_subject(e, remaining);
 
-    free(line);
     PRTESC(BOLD BLU);
     printf("Edit location:\n");
     PRTESC(RESET);
-    line = stredit(e->location);
-    remaining = line;
+    gapbuf_set(&gb, e->location);
+    stredit_buf(&gb);
+    remaining = gapbuf_str(&gb);
     for (; isspace(*remaining) && *remaining; remaining++);
     if (*remaining)
         event_set_location(e, remaining);
 
-    free(line);
     PRTESC(BOLD BLU);
     printf("Edit details:\n");
     PRTESC(RESET);
-    line = stredit(e->details);
-    remaining = line;
+    gapbuf_set(&gb, e->details);
+    stredit_buf(&gb);
+    remaining = gapbuf_str(&gb);
     for (; isspace(*remaining) && *remaining; remaining++);
     if (*remaining)
         event_set_details(e, remaining);
 
+    for (;;) {
+        PRTESC(BOLD BLU);
+        printf("Edit recurrence (e.g. weekly, every 2 weeks until MM/DD/YYYY, none):\n");
+        PRTESC(RESET);
+        char *recur = recur_to_str(e->recur);
+        gapbuf_set(&gb, recur);
+        free(recur);
+        stredit_buf(&gb);
+        remaining = gapbuf_str(&gb);
+        Recurrence r = recur_from_str(remaining);
+        if (!recur_validate(r)) {
+            printf(BAD_IN_FRMT_SPEC, INV_RECR, remaining);
+            continue;
+        }
+        event_set_recurrence(e, r);
+        break;
+    }
+
     /* for (unsigned i = 0; i < e->ntags; i++) { */
     /*     PRTESC(BOLD BLU); */
     /*     if (i < e->ntags - 1) */
@@ -440,7 +879,7 @@ static int edit_event_prompt(Event *e)
     /*     event_add_tag(e, str_dup(remaining)); */
     /* } */
 
-    free(line);
+    gapbuf_destroy(&gb);
 
     return 0;
 }
@@ -509,6 +948,27 @@ static int new_event_prompt(Event *e)
         }
     }
 
+    while (!time_is_null(e->time)) {
+        PRTESC(BOLD BLU);
+        printf("Please enter a duration (e.g. 45m, 1h30m), or return for none:\n");
+        PRTESC(RESET);
+        if (getline(&line, &size, stdin) == -1)
+            FATAL("Failed to read from stdin!");
+        if (line[strlen(line) - 1] == '\n')
+            line[strlen(line) - 1] = '\0';
+        remaining = line;
+        for (; isspace(*remaining) && *remaining; remaining++);
+        if (!*remaining)
+            break;
+        int minutes = duration_from_str(remaining);
+        if (minutes == -1) {
+            printf(BAD_IN_FRMT_SPEC, INV_DRTN, remaining);
+            continue;
+        }
+        event_set_duration(e, minutes);
+        break;
+    }
+
     for (;;) {
         PRTESC(BOLD BLU);
         printf("Please enter a priority (Low, Medium, High, Urgent):\n");
@@ -576,6 +1036,24 @@ static int new_event_prompt(Event *e)
     if (*remaining)
         event_set_details(e, remaining);
 
+    for (;;) {
+        PRTESC(BOLD BLU);
+        printf("Please enter a recurrence (e.g. weekly, every 2 weeks until MM/DD/YYYY),"
+               " or return for none:\n");
+        PRTESC(RESET);
+        if (getline(&line, &size, stdin) == -1)
+            FATAL("Failed to read from stdin!");
+        if (line[strlen(line) - 1] == '\n')
+            line[strlen(line) - 1] = '\0';
+        Recurrence r = recur_from_str(line);
+        if (!recur_validate(r)) {
+            printf(BAD_IN_FRMT_SPEC, INV_RECR, line);
+            continue;
+        }
+        event_set_recurrence(e, r);
+        break;
+    }
+
     for (;;) {
         PRTESC(BOLD BLU);
         printf("Please enter a tag, or return if finished:\n");
@@ -596,269 +1074,1316 @@ static int new_event_prompt(Event *e)
     return 0;
 }
 
-static void interactive_mode(Database *db, char **filepath)
+/* Parses a date from the tokens at *line for the pager. Each pager
+ * command reads the date afresh. */
+static Date pager_date(char **line)
 {
-    char *tok, *remaining, *line = NULL;
-    Date d;
-    size_t size;
-    size_t nevents;
-    Event *events;
-
-    for (;;) {
-        PRTESC(BOLD BLU);
-
-        printf("> ");
-        fflush(stdout);
+    current_date = NULL_DATE;
+    return get_date_from_toks(line);
+}
 
-        if (getline(&line, &size, stdin) == -1)
-            FATAL("Failed to read from stdin!");
+static void print_events(Event *events, size_t n)
+{
+    pager_print_arr(events, n, PRINT_ALL, pager_date);
+}
 
-        PRTESC(RESET);
+/* Prints the events at a date, a date and time, or a range of dates */
+static int query_dates(Session *s, char *line)
+{
+    Event *events;
+    size_t nevents;
+    char *tok, *remaining = line;
 
-        if (line[strlen(line) - 1] == '\n')
-            line[strlen(line) - 1] = '\0';
+    Date d = get_date_from_toks(&remaining);
+    if (date_is_null(d)) {
+        if (!remaining)
+            return -1;
+        tok = next_tok(&remaining);
+        if (tok && *tok)
+            fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+        free(tok);
+        return -1;
+    }
 
-        remaining = line;
+    char *range = remaining;
+    tok = next_tok(&range);
+    if (tok && !strcmp(tok, "to")) {
+        free(tok);
+        if (!*range) {
+            fprintf(stderr, "%s\n", RQRS_ARG);
+            return -1;
+        }
 
-        if (!date_is_null(d = get_date_from_toks(&remaining))) {
-            if (*remaining) {
-                Time t = time_from_str(remaining);
-
-                if (!time_is_null(t)) {
-                    tok = next_tok(&remaining);
-                    for (; isspace(*remaining) && *remaining; remaining++);
-                    if (*remaining) {
-                        fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                        free(tok);
-                        continue;
-                    }
-                    if (!time_validate(t)) {
-                        fprintf(stderr, BAD_IN_FRMT_SPEC, INV_TIME, tok);
-                        free(tok);
-                        continue;
-                    } else {
-                        if (database_query_date_and_time(db, d, t, &events, &nevents) != -1) {
-                            event_print_arr(events, nevents, PRINT_ALL);
-                            free(events);
-                        }
-                        free(tok);
-                        continue;
-                    }
-                } else {
-                    fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                    continue;
-                }
-            }
+        Date to = get_date_from_toks(&range);
+        if (date_is_null(to)) {
+            if (range)
+                fprintf(stderr, BAD_IN_FRMT_SPEC, BAD_ARG, range);
+            return -1;
+        } else if (*range) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, range);
+            return -1;
+        }
 
-            if (database_query_date(db, d, &events, &nevents) != -1) {
-                event_print_arr(events, nevents, PRINT_ALL);
-                free(events);
-            }
+        if (database_query_range(s->db, d, to, &events, &nevents) == -1)
+            return -1;
+        print_events(events, nevents);
+        free(events);
+        return 0;
+    }
+    free(tok);
 
-            continue;
-        } else if (!remaining) {
-            continue;
+    if (*remaining) {
+        Time t = time_from_str(remaining);
+        if (time_is_null(t)) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
+            return -1;
         }
 
         tok = next_tok(&remaining);
+        for (; isspace(*remaining) && *remaining; remaining++);
+        free(tok);
+        if (*remaining) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
+            return -1;
+        }
 
-        if (!tok) {
-            continue;
-        } else if (!strcmp(tok, "all")) {
-            free(tok);
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                continue;
-            }
-            event_print_arr(db->events, db->count, PRINT_ALL);
-        } else if (!strcmp(tok, "date")) {
-            free(tok);
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                continue;
-            }
-            date_print(get_current_date());
-        } else if (!strcmp(tok, "edit")) {
-            free(tok);
-
-            if (!*remaining) {
-                fprintf(stderr, "%s\n", RQRS_ARG);
-                continue;
-            }
+        if (database_query_date_and_time(s->db, d, t, &events, &nevents) == -1)
+            return -1;
+        print_events(events, nevents);
+        free(events);
+        return 0;
+    }
 
-            Event old, new;
-            if (select_event(db, &remaining, &old) != -1) {
-                event_clone(&new, old);
-                edit_event_prompt(&new);
-                database_remove_event(db, old);
-                database_add_event(db, new);
-            }
+    if (database_query_date(s->db, d, &events, &nevents) == -1)
+        return -1;
+    print_events(events, nevents);
+    free(events);
+    return 0;
+}
 
-            continue;
-        } else if (!strcmp(tok, "load")) {
-            free(tok);
-            tok = next_tok(&remaining);
-
-            if (database_is_modified(db)) {
-                switch (get_ync(
-                        "Database has been modified.\n"
-                        "Would you like to save before loading the new database? (y/n/c) "
-                            )) {
-                case 1 :
-                    if (save(db, *filepath) == -1) {
-                        if (get_ync(
-                            "Could not save database.\n"
-                            "Would you like to load the new database anyway? (y/n/c) "
-                            ) < 1) {
-                            continue;
-                        }
-                    }
-                    break;
-                case 0 :
-                    break;
-                case -1 :
-                    continue;
-                }
-            }
+/* Reads the single argument of a command into *arg, to be freed */
+static int get_arg(char *args, char **arg)
+{
+    *arg = next_tok(&args);
+    if (!*arg) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+    if (*args) {
+        fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, args);
+        free(*arg);
+        return -1;
+    }
+    return 0;
+}
 
+static int no_args(char *args)
+{
+    if (*args) {
+        fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, args);
+        return -1;
+    }
+    return 0;
+}
 
-            if (!tok) {
-                fprintf(stderr, "%s\n", RQRS_ARG);
-                continue;
-            }
+/* Offers to save a modified database before it is discarded, asking
+ * whether to go ahead if saving fails. Returns -1 if the user cancels. */
+static int save_changes(Session *s, char *ask, char *ask_anyway)
+{
+    //a save still running may fail, leaving changes unsaved
+    finish_save(s->db, true, false);
+    if (!database_is_modified(s->db))
+        return 0;
+
+    switch (get_ync(ask)) {
+    case 1 :
+        if (save(s->db, *s->filepath, false) == -1 && get_ync(ask_anyway) < 1)
+            return -1;
+        return 0;
+    case 0 :
+        return 0;
+    default :
+        return -1;
+    }
+}
 
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                free(tok);
-                continue;
-            }
+/* Writes an event's date, time span and subject on one line */
+static void print_span(Event e)
+{
+    char date[DATE_STR_LEN], from[TIME_STR_LEN], to[TIME_STR_LEN];
+    date_format(e.date, date);
+    time_format(e.time, from);
+    time_format(time_add_minutes(e.time, e.duration), to);
+    printf("%s %s-%s %s\n", date, from, to, e.subject ? e.subject : "");
+}
 
-            Database new_db;
+/* Warns of the events whose time e overlaps, other than e itself */
+static void warn_conflicts(Database *db, Event e)
+{
+    int64_t start, end;
+    Event *events;
+    size_t n;
+    if (!event_span(e, &start, &end) ||
+        database_query_overlaps(db, start, end, e.id, &events, &n) == -1)
+        return;
+
+    if (n) {
+        PRTESC(BOLD RED);
+        printf("Conflicts with:\n");
+        PRTESC(RESET);
+    }
+    for (size_t i = 0; i < n; i++)
+        print_span(events[i]);
+    free(events);
+}
 
-            switch (load(&new_db, tok)) {
-            case 0 :
-                break;
-            case -1 :
-                fprintf(stderr, "Failed to open file \"%s\"\n", tok);
-                free(tok);
-                exit(EXIT_FAILURE);
-                break;
-            case -2 :
-                continue;
-            default:
-                FATAL("How'd this happen? Error on line %d", __LINE__);
-            }
+static int cmd_agenda(Session *s, char *args)
+{
+    size_t n = AGENDA_LEN;
+    Priority min = LOW;
+    char *tok = next_tok(&args);
+
+    if (tok && isdigit((unsigned char)*tok)) {
+        char *end;
+        n = strtoul(tok, &end, 10);
+        if (*end) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, BAD_ARG, tok);
+            free(tok);
+            return -1;
+        }
+        free(tok);
+        tok = next_tok(&args);
+    }
+    if (tok) {
+        min = priority_from_str(tok);
+        if (!priority_validate(min))
+            fprintf(stderr, BAD_IN_FRMT_SPEC, INV_PRTY, tok);
+        free(tok);
+        if (!priority_validate(min))
+            return -1;
+    }
+    if (*args) {
+        fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, args);
+        return -1;
+    }
 
-            database_destroy(db);
-            *db = new_db;
-            *filepath = tok;
+    Event *events;
+    size_t nevents;
+    int err = database_query_agenda(s->db, get_current_date(), min, n, &events, &nevents);
+    if (err != -1) {
+        print_events(events, nevents);
+        free(events);
+    }
+    return err;
+}
 
-        } else if (!strcmp(tok, "new")) {
-            free(tok);
+/* Pages through the stored events in place, without copying them */
+static int cmd_all(Session *s, char *args)
+{
+    if (no_args(args) == -1)
+        return -1;
+    pager_print_store(s->db->events, PRINT_ALL, pager_date);
+    return 0;
+}
 
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                continue;
-            }
+/* Selection and changes of a bulk command. Unset fields are NULL, -1 or
+ * NULL_DATE. */
+typedef struct Bulk {
+    char *tag;
+    Priority priority;
+    Date from;
+    Date to;
+    long days; //to move events by, earlier if negative
+    Priority set_priority;
+    char *add_tag;
+    char *remove_tag;
+} Bulk;
+
+static bool bulk_match(Event e, void *data)
+{
+    Bulk *b = data;
+    bool any_date = date_is_null(b->from) && date_is_null(b->to);
+    return (!b->tag || event_contains_tag(e, b->tag)) &&
+        (!priority_validate(b->priority) || e.priority == b->priority) &&
+        (any_date || !date_is_null(e.date)) &&
+        (date_is_null(b->from) || date_compare(e.date, b->from) >= 0) &&
+        (date_is_null(b->to) || date_compare(e.date, b->to) <= 0);
+}
 
-            Event e;
-            new_event_prompt(&e);
-            database_add_event(db, e);
-            continue;
-        } else if (!strcmp(tok, "remove") || !strcmp(tok, "rm")) {
-            free(tok);
+static void bulk_change(Event *e, void *data)
+{
+    Bulk *b = data;
+    if (b->days && !date_is_null(e->date))
+        event_set_date(e, b->days > 0 ? date_add_days(e->date, b->days) :
+                                        date_sub_days(e->date, -b->days));
+    if (priority_validate(b->set_priority))
+        event_set_priority(e, b->set_priority);
+    if (b->add_tag)
+        event_add_tag(e, b->add_tag);
+    if (b->remove_tag)
+        event_remove_tag(e, b->remove_tag);
+}
 
-            if (!*remaining) {
-                fprintf(stderr, "%s\n", RQRS_ARG);
-                continue;
-            }
+/* Reads the value following a keyword of a bulk or find command into
+ * *value, freeing any earlier one */
+static int read_value(char **args, char **value)
+{
+    free(*value);
+    *value = next_tok(args);
+    if (!*value) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+    return 0;
+}
+
+static int read_priority(char **args, Priority *p)
+{
+    char *tok = NULL;
+    if (read_value(args, &tok) == -1)
+        return -1;
+    *p = priority_from_str(tok);
+    if (!priority_validate(*p))
+        fprintf(stderr, BAD_IN_FRMT_SPEC, INV_PRTY, tok);
+    free(tok);
+    return priority_validate(*p) ? 0 : -1;
+}
 
-            Event e;
-            if (select_event(db, &remaining, &e) != -1)
-                database_remove_event(db, e);
+static int read_date(char **args, Date *d)
+{
+    *d = get_date_from_toks(args);
+    if (!date_is_null(*d))
+        return 0;
+    if (*args)
+        fprintf(stderr, BAD_IN_FRMT_SPEC, BAD_ARG, *args);
+    return -1;
+}
 
-            continue;
-        } else if (!strcmp(tok, "tag")) {
+/* Parses "CONDITION... do CHANGE..." into b */
+static int parse_bulk(Bulk *b, char *args)
+{
+    char *tok;
+    int err = 0;
+    bool changes = false;
+
+    //conditions, up to "do"
+    while (!err) {
+        if (!(tok = next_tok(&args))) {
+            fprintf(stderr, "%s\n", RQRS_ARG);
+            return -1;
+        }
+        if (!strcmp(tok, "do")) {
             free(tok);
-            tok = next_tok(&remaining);
+            break;
+        }
 
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                continue;
-            }
+        if (!strcmp(tok, "tag")) {
+            err = read_value(&args, &b->tag);
+        } else if (!strcmp(tok, "priority")) {
+            err = read_priority(&args, &b->priority);
+        } else if (!strcmp(tok, "on")) {
+            err = read_date(&args, &b->from);
+            b->to = b->from;
+        } else if (!strcmp(tok, "from")) {
+            err = read_date(&args, &b->from);
+        } else if (!strcmp(tok, "to")) {
+            err = read_date(&args, &b->to);
+        } else {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+            err = -1;
+        }
+        free(tok);
+    }
 
-            if (database_query_tag(db, tok, &events, &nevents) != -1) {
-                event_print_arr(events, nevents, PRINT_ALL);
-                free(events);
+    //changes, to the end of the line
+    while (!err && (tok = next_tok(&args))) {
+        if (!strcmp(tok, "move")) {
+            char *days = NULL, *end;
+            if (!(err = read_value(&args, &days))) {
+                b->days = strtol(days, &end, 10);
+                if (*end || end == days) {
+                    fprintf(stderr, BAD_IN_FRMT_SPEC, BAD_ARG, days);
+                    err = -1;
+                }
             }
+            free(days);
+        } else if (!strcmp(tok, "priority")) {
+            err = read_priority(&args, &b->set_priority);
+        } else if (!strcmp(tok, "tag")) {
+            err = read_value(&args, &b->add_tag);
+        } else if (!strcmp(tok, "untag")) {
+            err = read_value(&args, &b->remove_tag);
+        } else {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+            err = -1;
+        }
+        changes = true;
+        free(tok);
+    }
 
-            free(tok);
-            continue;
-        } else if (!strcmp(tok, "save") || !strcmp(tok, "s")) {
-            free(tok);
-            if (save(db, *filepath) == -1)
-                fprintf(stderr, "Failed to save database\n");
-            continue;
-        } else if (!strcmp(tok, "saveas") || !strcmp(tok, "sa")) {
-            free(tok);
-            tok = next_tok(&remaining);
+    if (!err && !changes) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+    return err;
+}
 
-            if (!tok) {
-                fprintf(stderr, "%s\n", RQRS_ARG);
-                continue;
-            }
+static int cmd_bulk(Session *s, char *args)
+{
+    Bulk b = {NULL, -1, NULL_DATE, NULL_DATE, 0, -1, NULL, NULL};
+    int err = parse_bulk(&b, args);
+    if (err != -1) {
+        size_t changed = database_update_where(s->db, bulk_match, bulk_change, &b);
+        printf("Changed %zu event%s\n", changed, changed == 1 ? "" : "s");
+    }
+    free(b.tag);
+    free(b.add_tag);
+    free(b.remove_tag);
+    return err;
+}
 
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
-                free(tok);
-                continue;
-            }
+/* Colours of the priorities in the calendar */
+static const char *PRIORITY_COLOR[] = {
+    [LOW] = GRN,
+    [MEDIUM] = YEL,
+    [HIGH] = RED,
+    [URGENT] = BOLD RED
+};
 
-            if (save(db, tok) == -1) {
-                fprintf(stderr, "Failed to save database to file \"%s\"\n", tok);
-                free(tok);
-            } else {
-                *filepath = tok;
-            }
+/* Shades of the year heatmap, from no events to the busiest day */
+static const char HEAT[] = ".-+*#";
 
-            continue;
-        } else if (!strcmp(tok, "quit") || !strcmp(tok, "q")) {
-            free(tok);
-            if (*remaining) {
-                fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, remaining);
+static long days_of_month(unsigned month, unsigned year)
+{
+    Date next = month == 12 ? (Date){year + 1, 1, 1} : (Date){year, month + 1, 1};
+    return date_to_days(next) - date_to_days((Date){year, month, 1});
+}
+
+/* Prints a month grid giving each day's events and the initial of their
+ * highest priority */
+static void print_month(Database *db, unsigned month, unsigned year)
+{
+    Date first = {year, month, 1};
+    size_t ndays = days_of_month(month, year);
+    DayCount counts[31];
+    database_day_counts(db, first, ndays, counts);
+
+    printf("%s %u\n", date_month_name(month), year);
+    for (unsigned i = 0; i < 7; i++)
+        printf(i < 6 ? "%-8.3s" : "%.3s\n", date_day_name(i));
+
+    unsigned dow = date_day_of_week(first);
+    printf("%*s", (int)(8 * dow), "");
+    size_t total = 0;
+    for (size_t i = 0; i < ndays; i++) {
+        DayCount c = counts[i];
+        Priority p = daycount_max_priority(c);
+        char cell[16] = "";
+        if (c.events > 99)
+            sprintf(cell, "99+%.1s", priority_validate(p) ? priority_to_str(p) : "");
+        else if (c.events)
+            sprintf(cell, "%u%.1s", c.events, priority_validate(p) ? priority_to_str(p) : "");
+        total += c.events;
+
+        printf("%2zu ", i + 1);
+        if (TERM_COLOR && priority_validate(p))
+            printf("%s", PRIORITY_COLOR[p]);
+        bool last = (dow + i) % 7 == 6 || i == ndays - 1;
+        printf(last ? "%s" : "%-4s", cell);
+        if (TERM_COLOR && priority_validate(p))
+            printf(RESET);
+        printf(last ? "\n" : " ");
+    }
+    printf("%zu event%s\n", total, total == 1 ? "" : "s");
+}
+
+/* Prints a heatmap of the year with a column per week, shading each day
+ * by its events relative to the busiest day, then the total of each
+ * month */
+static void print_year(Database *db, unsigned year)
+{
+    Date first = {year, 1, 1};
+    size_t ndays = date_to_days((Date){year + 1, 1, 1}) - date_to_days(first);
+    DayCount counts[366];
+    database_day_counts(db, first, ndays, counts);
+
+    unsigned max = 0;
+    for (size_t i = 0; i < ndays; i++)
+        max = MAX(max, counts[i].events);
+
+    //month names above the week each month starts in
+    unsigned dow = date_day_of_week(first);
+    char labels[64];
+    memset(labels, ' ', sizeof(labels));
+    for (unsigned m = 1; m <= 12; m++) {
+        size_t week = (date_to_days((Date){year, m, 1}) - date_to_days(first) + dow) / 7;
+        memcpy(labels + week, date_month_name(m), 3);
+    }
+    size_t nweeks = (ndays - 1 + dow) / 7 + 1;
+    printf("%u\n    %.*s\n", year, (int)nweeks, labels);
+
+    for (unsigned row = 0; row < 7; row++) {
+        printf("%.3s ", date_day_name(row));
+        for (size_t week = 0; week < nweeks; week++) {
+            long i = 7 * week + row - dow;
+            if (i < 0 || i >= (long)ndays) {
+                putchar(' ');
                 continue;
             }
+            unsigned n = counts[i].events;
+            putchar(HEAT[n ? 1 + (n * 4 - 1) / max : 0]);
+        }
+        putchar('\n');
+    }
 
-            if (database_is_modified(db)) {
-                switch (get_ync(
-                        "Database has been modified.\n"
-                        "Would you like to save before quitting? (y/n/c) "
-                            )) {
-                case 1 :
-                    if (save(db, *filepath) == -1) {
-                        if (get_ync(
-                            "Could not save database.\n"
-                            "Would you like to quit anyway? (y/n/c) "
-                            ) < 1) {
-                            continue;
-                        }
-                    }
-                    break;
-                case 0 :
-                    break;
-                case -1 :
-                    continue;
-                }
-            }
+    putchar('\n');
+    for (unsigned m = 1; m <= 12; m++) {
+        Date from = {year, m, 1};
+        Date to = {year, m, days_of_month(m, year)};
+        printf("%.3s %-6zu%s", date_month_name(m), database_count_range(db, from, to),
+               m % 6 ? " " : "\n");
+    }
+    printf("%zu events\n", database_count_range(db, first, date_add_days(first, ndays - 1)));
+}
 
-            return;
+static int cmd_cal(Session *s, char *args)
+{
+    Date today = get_current_date();
+    unsigned month = today.month, year = today.year;
+    bool whole_year = false;
+
+    char *tok = next_tok(&args);
+    if (tok) {
+        //a bare number is a month of this year unless it has four digits
+        char *end = tok;
+        unsigned n = isdigit((unsigned char)*tok) ? strtoul(tok, &end, 10) : 0;
+        if (*end == '/' && isdigit((unsigned char)end[1])) {
+            month = n;
+            year = strtoul(end + 1, &end, 10);
+        } else if (end - tok == 4) {
+            year = n;
+            whole_year = true;
         } else {
-            if (*tok)
-                fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+            month = n;
+        }
+        if (*end || end == tok || !date_validate((Date){year, month, 1})) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, INV_DATE, tok);
             free(tok);
+            return -1;
+        }
+        free(tok);
+    }
+    if (no_args(args) == -1)
+        return -1;
+
+    if (whole_year)
+        print_year(s->db, year);
+    else
+        print_month(s->db, month, year);
+    return 0;
+}
+
+static int cmd_date(Session *s, char *args)
+{
+    if (no_args(args) == -1)
+        return -1;
+    date_print(get_current_date());
+    return 0;
+}
+
+static int cmd_dedup(Session *s, char *args)
+{
+    if (no_args(args) == -1)
+        return -1;
+    size_t removed = database_dedup(s->db);
+    printf("Removed %zu duplicate event%s\n", removed, removed == 1 ? "" : "s");
+    return 0;
+}
+
+static int cmd_diff(Session *s, char *args)
+{
+    char *path;
+    if (get_arg(args, &path) == -1)
+        return -1;
+
+    StoreIter it = store_iter(s->db->events, 0);
+    int err = diff_file(diff_source_database(&it), path);
+    free(path);
+    return err;
+}
+
+static int cmd_edit(Session *s, char *args)
+{
+    if (!*args) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+
+    Event old, new;
+    if (select_event(s->db, &args, &old) == -1)
+        return -1;
+
+    //edit the whole series when given an occurrence
+    event_clone(&new, *database_get_event(s->db, old.id));
+    edit_event_prompt(&new);
+    warn_conflicts(s->db, new);
+    database_update_event(s->db, new);
+    return 0;
+}
+
+/* Consumes the next token if it is word */
+static bool accept(char **args, const char *word)
+{
+    char *rest = *args;
+    char *tok = next_tok(&rest);
+    bool match = tok && !strcmp(tok, word);
+    if (match)
+        *args = rest;
+    free(tok);
+    return match;
+}
+
+static Query *parse_or(char **args);
+
+static int parse_compare(char **args, Query *q)
+{
+    static const struct {
+        const char *text;
+        unsigned cmp;
+    } OPS[] = {
+        {"=", QUERY_EQ},
+        {"!=", QUERY_LT | QUERY_GT},
+        {"<", QUERY_LT},
+        {"<=", QUERY_LT | QUERY_EQ},
+        {">", QUERY_GT},
+        {">=", QUERY_GT | QUERY_EQ}
+    };
+
+    q->cmp = QUERY_EQ;
+    for (unsigned i = 0; i < sizeof(OPS) / sizeof(OPS[0]); i++) {
+        if (accept(args, OPS[i].text)) {
+            q->cmp = OPS[i].cmp;
+            break;
+        }
+    }
+    return read_priority(args, &q->priority);
+}
+
+/* Parses a predicate, a negated factor or a bracketed expression */
+static Query *parse_factor(char **args)
+{
+    char *tok = next_tok(args);
+    if (!tok) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return NULL;
+    }
+
+    Query *q = NULL;
+    int err = 0;
+    if (!strcmp(tok, "not")) {
+        Query *operand = parse_factor(args);
+        if (operand)
+            q = query_new(QUERY_NOT, operand, NULL);
+        err = operand ? 0 : -1;
+    } else if (!strcmp(tok, "(")) {
+        q = parse_or(args);
+        if (q && !accept(args, ")")) {
+            if (*args && **args)
+                fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, *args);
+            else
+                fprintf(stderr, "%s\n", INC_SPEC);
+            err = -1;
+        }
+        err = q ? err : -1;
+    } else if (!strcmp(tok, "tag") || !strcmp(tok, "text")) {
+        q = query_new(!strcmp(tok, "tag") ? QUERY_TAG : QUERY_TEXT, NULL, NULL);
+        err = read_value(args, &q->text);
+    } else if (!strcmp(tok, "priority")) {
+        q = query_new(QUERY_PRIORITY, NULL, NULL);
+        err = parse_compare(args, q);
+    } else if (!strcmp(tok, "on")) {
+        q = query_new(QUERY_DATE, NULL, NULL);
+        err = read_date(args, &q->from);
+        q->to = q->from;
+    } else if (!strcmp(tok, "from")) {
+        q = query_new(QUERY_DATE, NULL, NULL);
+        err = read_date(args, &q->from);
+        if (!err && accept(args, "to"))
+            err = read_date(args, &q->to);
+    } else if (!strcmp(tok, "to")) {
+        q = query_new(QUERY_DATE, NULL, NULL);
+        err = read_date(args, &q->to);
+    } else {
+        fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+        err = -1;
+    }
+    free(tok);
+
+    if (err == -1) {
+        query_free(q);
+        return NULL;
+    }
+    return q;
+}
+
+static Query *parse_and(char **args)
+{
+    Query *q = parse_factor(args);
+    while (q && accept(args, "and")) {
+        Query *right = parse_factor(args);
+        if (!right) {
+            query_free(q);
+            return NULL;
+        }
+        q = query_new(QUERY_AND, q, right);
+    }
+    return q;
+}
+
+static Query *parse_or(char **args)
+{
+    Query *q = parse_and(args);
+    while (q && accept(args, "or")) {
+        Query *right = parse_and(args);
+        if (!right) {
+            query_free(q);
+            return NULL;
+        }
+        q = query_new(QUERY_OR, q, right);
+    }
+    return q;
+}
+
+/* Parses the expression of a find command. Returns NULL on error. */
+static Query *parse_query(const char *args)
+{
+    //brackets are tokens of their own, even next to a word
+    char *spaced = malloc(3 * strlen(args) + 1);
+    if (!spaced)
+        FATAL("Failed to allocate query!");
+    char *out = spaced;
+    for (const char *c = args; *c; c++) {
+        if (*c == '(' || *c == ')') {
+            *out++ = ' ';
+            *out++ = *c;
+            *out++ = ' ';
+        } else {
+            *out++ = *c;
+        }
+    }
+    *out = '\0';
+
+    char *line = spaced;
+    Query *q = parse_or(&line);
+    if (q && line && *line) {
+        fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, line);
+        query_free(q);
+        q = NULL;
+    }
+    free(spaced);
+    return q;
+}
+
+static int cmd_explain(Session *s, char *args)
+{
+    if (!accept(&args, "find")) {
+        char *tok = next_tok(&args);
+        if (tok)
+            fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+        else
+            fprintf(stderr, "%s\n", RQRS_ARG);
+        free(tok);
+        return -1;
+    }
+
+    Query *q = parse_query(args);
+    if (!q)
+        return -1;
+    QueryPlan plan;
+    query_plan(s->db, q, &plan);
+    query_plan_fprint(&plan, stdout);
+    query_plan_destroy(&plan);
+    query_free(q);
+    return 0;
+}
+
+static int cmd_export_ics(Session *s, char *args)
+{
+    char *path;
+    if (get_arg(args, &path) == -1)
+        return -1;
+
+    FILE *f = fopen(path, "w");
+    int err = -1;
+    if (!f)
+        fprintf(stderr, "Failed to open file \"%s\"\n", path);
+    else if ((err = ics_export(s->db, f)) == -1)
+        fprintf(stderr, "Failed to write file \"%s\"\n", path);
+    if (f)
+        fclose(f);
+    free(path);
+    return err;
+}
+
+static int cmd_find(Session *s, char *args)
+{
+    Query *q = parse_query(args);
+    if (!q)
+        return -1;
+
+    QueryPlan plan;
+    query_plan(s->db, q, &plan);
+    Event *events;
+    size_t nevents;
+    int err = query_run(s->db, q, &plan, &events, &nevents);
+    if (err != -1) {
+        print_events(events, nevents);
+        free(events);
+    }
+    query_plan_destroy(&plan);
+    query_free(q);
+    return err;
+}
+
+static int cmd_free(Session *s, char *args)
+{
+    char *remaining = args;
+    Date d = get_date_from_toks(&remaining);
+    if (date_is_null(d)) {
+        char *tok = remaining ? next_tok(&remaining) : NULL;
+        if (tok)
+            fprintf(stderr, BAD_IN_FRMT_SPEC, INV_DATE, tok);
+        else if (remaining)
+            fprintf(stderr, "%s\n", RQRS_ARG);
+        free(tok);
+        return -1;
+    }
+
+    unsigned min = 0;
+    char *tok = next_tok(&remaining);
+    if (tok) {
+        int minutes = duration_from_str(tok);
+        if (minutes == -1)
+            fprintf(stderr, BAD_IN_FRMT_SPEC, INV_DRTN, tok);
+        free(tok);
+        if (minutes == -1)
+            return -1;
+        min = minutes;
+    }
+    if (no_args(remaining) == -1)
+        return -1;
+
+    Interval *slots;
+    size_t n;
+    if (database_free_slots(s->db, d, min, &slots, &n) == -1)
+        return -1;
+    if (!n)
+        printf("No free time\n");
+    int64_t day = (int64_t)date_to_days(d) * DAY_MINUTES;
+    for (size_t i = 0; i < n; i++) {
+        unsigned from = slots[i].start - day, to = slots[i].end - day;
+        char len[DURATION_STR_LEN];
+        duration_format(to - from, len);
+        printf("%02u:%02u-%02u:%02u %s\n", from / 60, from % 60, to / 60, to % 60, len);
+    }
+    free(slots);
+    return 0;
+}
+
+static int cmd_import_ics(Session *s, char *args)
+{
+    char *path;
+    if (get_arg(args, &path) == -1)
+        return -1;
+
+    FILE *f = fopen(path, "r");
+    int added = -1;
+    if (!f) {
+        fprintf(stderr, "Failed to open file \"%s\"\n", path);
+    } else if ((added = ics_import(s->db, f)) == -1) {
+        fprintf(stderr, "Failed to read file \"%s\"\n", path);
+    } else {
+        printf("Imported %d event%s\n", added, added == 1 ? "" : "s");
+    }
+    if (f)
+        fclose(f);
+    free(path);
+    return added == -1 ? -1 : 0;
+}
+
+static int cmd_load(Session *s, char *args)
+{
+    char *path = next_tok(&args);
+
+    if (save_changes(s,
+            "Database has been modified.\n"
+            "Would you like to save before loading the new database? (y/n/c) ",
+            "Could not save database.\n"
+            "Would you like to load the new database anyway? (y/n/c) ") == -1) {
+        free(path);
+        return -1;
+    }
+
+    if (!path) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+
+    if (*args) {
+        fprintf(stderr, BAD_IN_FRMT_SPEC, EXTR_TXT, args);
+        free(path);
+        return -1;
+    }
+
+    Database new_db;
+
+    switch (load(&new_db, path)) {
+    case 0 :
+        break;
+    case -1 :
+        fprintf(stderr, "Failed to open file \"%s\"\n", path);
+        free(path);
+        exit(EXIT_FAILURE);
+        break;
+    case -2 :
+        return -1;
+    default:
+        FATAL("How'd this happen? Error on line %d", __LINE__);
+    }
+
+    database_destroy(s->db);
+    *s->db = new_db;
+    *s->filepath = path;
+    return 0;
+}
+
+static int cmd_merge(Session *s, char *args)
+{
+    char *path;
+    if (get_arg(args, &path) == -1)
+        return -1;
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open file \"%s\"\n", path);
+        free(path);
+        return -1;
+    }
+    free(path);
+
+    Database other;
+    int err = database_load(&other, f);
+    fclose(f);
+    if (err == -1) {
+        database_destroy(&other);
+        return -1;
+    }
+
+    size_t added = database_merge(s->db, &other);
+    printf("Merged %zu new event%s\n", added, added == 1 ? "" : "s");
+    return 0;
+}
+
+static int cmd_new(Session *s, char *args)
+{
+    if (no_args(args) == -1)
+        return -1;
+
+    Event e;
+    new_event_prompt(&e);
+    warn_conflicts(s->db, e);
+    database_add_event(s->db, e);
+    return 0;
+}
+
+static int cmd_remove(Session *s, char *args)
+{
+    if (!*args) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+
+    Event e;
+    if (select_event(s->db, &args, &e) == -1)
+        return -1;
+    database_remove_event(s->db, e);
+    return 0;
+}
+
+/* Reads the next tag of "TAG [and [not] TAG]..." into all or none.
+ * Returns 1 once a tag has been read, or -1 on error. */
+static int tag_term(char **args, char **all, size_t *nall, char **none, size_t *nnone)
+{
+    char *tok = next_tok(args);
+    bool not = tok && !strcmp(tok, "not");
+    if (not) {
+        free(tok);
+        tok = next_tok(args);
+    }
+    if (!tok) {
+        fprintf(stderr, "%s\n", RQRS_ARG);
+        return -1;
+    }
+
+    if (not)
+        none[(*nnone)++] = tok;
+    else
+        all[(*nall)++] = tok;
+    return 1;
+}
+
+static int cmd_tag(Session *s, char *args)
+{
+    //terms take at least two characters each
+    size_t max = strlen(args) / 2 + 1;
+    char **all = malloc(max * sizeof(all[0]));
+    char **none = malloc(max * sizeof(none[0]));
+    if (!all || !none)
+        FATAL("Failed to allocate tag list!");
+    size_t nall = 0, nnone = 0;
+
+    int err = tag_term(&args, all, &nall, none, &nnone);
+    for (char *tok; err != -1 && (tok = next_tok(&args));) {
+        if (strcmp(tok, "and")) {
+            fprintf(stderr, BAD_IN_FRMT_SPEC, UNRC_TOK, tok);
+            err = -1;
+        } else {
+            err = tag_term(&args, all, &nall, none, &nnone);
+        }
+        free(tok);
+    }
+
+    if (err != -1) {
+        Event *events;
+        size_t nevents;
+        err = database_query_tags(s->db, (const char **)all, nall,
+                                  (const char **)none, nnone, &events, &nevents);
+        if (err != -1) {
+            print_events(events, nevents);
+            free(events);
+        }
+    }
+
+    for (size_t i = 0; i < nall; i++)
+        free(all[i]);
+    for (size_t i = 0; i < nnone; i++)
+        free(none[i]);
+    free(all);
+    free(none);
+    return err;
+}
+
+static int cmd_save(Session *s, char *args)
+{
+    if (start_save(s->db, *s->filepath, false) == -1) {
+        fprintf(stderr, "Failed to save database\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int cmd_saveas(Session *s, char *args)
+{
+    char *path;
+    if (get_arg(args, &path) == -1)
+        return -1;
+
+    //the session moves to the file only once it is written
+    if (save(s->db, path, true) == -1) {
+        free(path);
+        return -1;
+    }
+    *s->filepath = path;
+    return 0;
+}
+
+static int cmd_quit(Session *s, char *args)
+{
+    if (no_args(args) == -1)
+        return -1;
+    if (save_changes(s,
+            "Database has been modified.\n"
+            "Would you like to save before quitting? (y/n/c) ",
+            "Could not save database.\n"
+            "Would you like to quit anyway? (y/n/c) ") == -1)
+        return -1;
+    s->done = true;
+    return 0;
+}
+
+/* Adds the commands of the interactive session to the dispatch table */
+static void register_commands(void)
+{
+    command_register("agenda", cmd_agenda);
+    command_register("all", cmd_all);
+    command_register("bulk", cmd_bulk);
+    command_register("cal", cmd_cal);
+    command_register("date", cmd_date);
+    command_register("dedup", cmd_dedup);
+    command_register("diff", cmd_diff);
+    command_register("edit", cmd_edit);
+    command_register("explain", cmd_explain);
+    command_register("export-ics", cmd_export_ics);
+    command_register("find", cmd_find);
+    command_register("free", cmd_free);
+    command_register("import-ics", cmd_import_ics);
+    command_register("load", cmd_load);
+    command_register("merge", cmd_merge);
+    command_register("new", cmd_new);
+    command_register("remove", cmd_remove);
+    command_register("rm", cmd_remove);
+    command_register("tag", cmd_tag);
+    command_register("save", cmd_save);
+    command_register("s", cmd_save);
+    command_register("saveas", cmd_saveas);
+    command_register("sa", cmd_saveas);
+    command_register("quit", cmd_quit);
+    command_register("q", cmd_quit);
+}
+
+/* Fills trie with command names and date keywords for tab completion */
+static void init_keywords(Trie *keywords)
+{
+    trie_init(keywords);
+    for (size_t i = 0; i < command_count(); i++)
+        trie_insert(keywords, command_get(i)->name);
+    for (unsigned i = 0; i < COUNTOF(KEYWORDS); i++)
+        trie_insert(keywords, KEYWORDS[i]);
+
+    for (unsigned i = 0; i < 7; i++) {
+        char day[16];
+        strcpy(day, date_day_name(i));
+        trie_insert(keywords, day);
+        day[0] = tolower(day[0]);
+        trie_insert(keywords, day);
+    }
+}
+
+static void interactive_mode(Database *db, char **filepath)
+{
+    char *line, *buf = NULL;
+    size_t size;
+    Session s = {db, filepath};
+
+    bool tty = isatty(STDIN_FILENO);
+    GapBuf input;
+    Trie keywords;
+    const Trie *completions[] = {&keywords, &db->tags};
+    register_commands();
+    gapbuf_init(&input, NULL);
+    init_keywords(&keywords);
+    stredit_set_completion(completions, COUNTOF(completions));
+
+    watch_init(&watch, *filepath);
+    if (tty) {
+        //keys must reach the fd, not stdin's buffer, to be seen by poll
+        setvbuf(stdin, NULL, _IONBF, 0);
+    }
+
+    while (!s.done) {
+        autosave(db, *filepath);
+        PRTESC(BOLD BLU);
+
+        printf("> ");
+        fflush(stdout);
+
+        if (tty) {
+            wait_for_input(db, *filepath);
+            gapbuf_set(&input, NULL);
+            if (stredit_buf(&input) == EOF)
+                FATAL("Failed to read from stdin!");
+            line = gapbuf_str(&input);
+        } else {
+            if (getline(&buf, &size, stdin) == -1)
+                FATAL("Failed to read from stdin!");
+            line = buf;
+        }
+
+        PRTESC(RESET);
+
+        //pick up a save finished and changes made while the command was
+        //typed, the latter only once the file is no longer being saved
+        finish_save(db, false, false);
+        if (!job.running && watch_changed(&watch))
+            reload(db, *filepath);
+
+        size_t len = strlen(line);
+        if (len && line[len - 1] == '\n')
+            line[len - 1] = '\0';
+
+        //dates in the command are relative to when it was entered
+        current_date = NULL_DATE;
+
+        char *args = line;
+        char *tok = next_tok(&args);
+        if (!tok)
             continue;
+        const Command *c = command_find(tok);
+        free(tok);
+
+        if (c)
+            c->run(&s, args);
+        else
+            query_dates(&s, line);
+    }
+
+    finish_save(db, true, false);
+    if (job.done[0] != -1) {
+        close(job.done[0]);
+        close(job.done[1]);
+    }
+    stredit_set_completion(NULL, 0);
+    trie_destroy(&keywords);
+    gapbuf_destroy(&input);
+    watch_destroy(&watch);
+    free(buf);
+}
+
+/* State of todo --remind */
+typedef struct Reminders {
+    Database *db;
+    TimerWheel wheel;
+    unsigned lead;    //minutes before events to remind of them
+    const char *hook; //command run for each reminder, or NULL to print it
+    long filled;      //last day whose events are in the wheel
+} Reminders;
+
+/* Minutes since 01/01/1970 in local time */
+static int64_t current_minute(void)
+{
+    time_t t = time(NULL);
+    struct tm *time = localtime(&t);
+    Date d = {time->tm_year + 1900, time->tm_mon + 1, time->tm_mday};
+    return (int64_t)date_to_days(d) * DAY_MINUTES + time->tm_hour * 60 + time->tm_min;
+}
+
+/* Runs hook in the background with the fields of e in the environment */
+static void run_hook(const char *hook, Event e)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+        fprintf(stderr, "Failed to run hook \"%s\"\n", hook);
+    if (pid)
+        return;
+
+    char id[32], date[DATE_STR_LEN], time[TIME_STR_LEN] = "";
+    sprintf(id, "%" PRIu64, e.id);
+    date_format(e.date, date);
+    if (!time_is_null(e.time))
+        time_format(e.time, time);
+    setenv("TODO_ID", id, 1);
+    setenv("TODO_DATE", date, 1);
+    setenv("TODO_TIME", time, 1);
+    setenv("TODO_PRIORITY", priority_validate(e.priority) ? priority_to_str(e.priority) : "", 1);
+    setenv("TODO_SUBJECT", e.subject ? e.subject : "", 1);
+    setenv("TODO_LOCATION", e.location ? e.location : "", 1);
+    setenv("TODO_DETAILS", e.details ? e.details : "", 1);
+    execl("/bin/sh", "sh", "-c", hook, (char *)NULL);
+    _exit(127);
+}
+
+static void remind(const Timer *t, void *data)
+{
+    Reminders *r = data;
+    Event *stored = database_get_event(r->db, t->id);
+    if (!stored)
+        return;
+
+    //the occurrence of a recurring event
+    Event e = *stored;
+    e.date = date_from_days(t->start / DAY_MINUTES);
+    if (r->hook) {
+        run_hook(r->hook, e);
+        return;
+    }
+
+    char date[DATE_STR_LEN], time[TIME_STR_LEN];
+    date_format(e.date, date);
+    printf("%s", date);
+    if (!time_is_null(e.time)) {
+        time_format(e.time, time);
+        printf(" %s", time);
+    }
+    printf(" %s", e.subject ? e.subject : "");
+    if (e.location)
+        printf(" at %s", e.location);
+    printf("\n");
+}
+
+/* Adds reminders of the events of the day after the last one added,
+ * found through a date ordered scan. Events without a time start at
+ * midnight. */
+static void fill_day(Reminders *r)
+{
+    r->filled++;
+    Date d = date_from_days(r->filled);
+    Event *events;
+    size_t n;
+    if (database_query_range(r->db, d, d, &events, &n) == -1)
+        return;
+
+    for (size_t i = 0; i < n; i++) {
+        int64_t start = (int64_t)r->filled * DAY_MINUTES;
+        if (!time_is_null(events[i].time))
+            start += events[i].time.hour * 60 + events[i].time.minute;
+        //reminders already due are skipped by the wheel
+        wheel_add(&r->wheel, start - r->lead, start, events[i].id);
+    }
+    free(events);
+}
+
+/* Keeps the reminders due up to REMIND_AHEAD minutes on in the wheel */
+static void fill(Reminders *r)
+{
+    while ((int64_t)(r->filled + 1) * DAY_MINUTES - r->lead <= r->wheel.now + REMIND_AHEAD)
+        fill_day(r);
+}
+
+/* Empties the wheel and fills it afresh from now, for after the events
+ * changed */
+static void refill(Reminders *r, int64_t now)
+{
+    wheel_destroy(&r->wheel);
+    wheel_init(&r->wheel, now);
+    //no event starting before this day is due after now
+    r->filled = (now + r->lead) / DAY_MINUTES - 1;
+    fill(r);
+}
+
+/* Prints, or runs hook on, each event as it comes due, lead minutes
+ * before it starts, until killed. The wheel holds only the reminders of
+ * the next REMIND_AHEAD minutes, and is filled afresh whenever the
+ * database file changes. */
+static void remind_mode(Database *db, const char *filepath, unsigned lead, const char *hook)
+{
+    Reminders r = {db, .lead = lead, .hook = hook};
+    //hooks are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    watch_init(&watch, filepath);
+
+    //reminders due this minute are still to come
+    wheel_init(&r.wheel, current_minute() - 1);
+    refill(&r, r.wheel.now);
+
+    struct pollfd fds[] = {{watch.fd, POLLIN}};
+    for (;;) {
+        wheel_advance(&r.wheel, current_minute(), remind, &r);
+        fill(&r);
+        fflush(stdout);
+
+        //sleep until the next minute unless the file changes
+        int timeout = (60 - time(NULL) % 60) * 1000;
+        if (poll(fds, watch.fd != -1, timeout) == -1 && errno != EINTR)
+            break;
+        if (watch_changed(&watch)) {
+            reload(db, filepath);
+            refill(&r, r.wheel.now);
         }
     }
+
+    wheel_destroy(&r.wheel);
+    watch_destroy(&watch);
 }
 
 static char *get_default_file_path(void)
@@ -881,8 +2406,20 @@ int main(int argc, char **argv)
 
     bool interactive = false;
     char *filepath = get_default_file_path();
+    char *diff_path = NULL;
+    bool reminding = false;
+    unsigned lead = 0;
+    char *hook = NULL;
+    static struct option long_options[] = {
+        {"diff", required_argument, NULL, 'd'},
+        {"remind", no_argument, NULL, 'r'},
+        {"lead", required_argument, NULL, 'l'},
+        {"hook", required_argument, NULL, 'x'},
+        {"autosave", required_argument, NULL, 'a'},
+        {0, 0, 0, 0}
+    };
     int option;
-    while ((option = getopt(argc, argv, "c:f:i")) != -1) {
+    while ((option = getopt_long(argc, argv, "c:f:i", long_options, NULL)) != -1) {
         switch (option) {
         case 'c':
             if (optarg[0] == '-') {
@@ -905,13 +2442,46 @@ int main(int argc, char **argv)
         case 'i':
             interactive = true;
             break;
+        case 'd':
+            diff_path = optarg;
+            break;
+        case 'r':
+            reminding = true;
+            break;
+        case 'l': {
+            int minutes = duration_from_str(optarg);
+            if (minutes == -1 && strcmp(optarg, "0"))
+                FATAL(BAD_IN_FRMT_SPEC, INV_DRTN, optarg);
+            lead = MAX(minutes, 0);
+            break;
+        }
+        case 'x':
+            hook = optarg;
+            break;
+        case 'a': {
+            char *endptr;
+            long secs = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || endptr == optarg || secs < 0 || secs > INT_MAX / 1000)
+                FATAL(BAD_IN_FRMT_SPEC, BAD_ARG, optarg);
+            autosave_secs = secs;
+            break;
+        }
         case '?':
             return EXIT_FAILURE;
         }
     }
 
+    if (diff_path) {
+        if (optind != argc - 1)
+            FATAL("%s: --diff requires two files\n", argv[0]);
+        int err = diff_files(diff_path, argv[optind]);
+        free(filepath);
+        return err == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
     Database db;
 
+    int lock = lock_file(filepath, F_RDLCK);
     if (!file_exists(filepath)) {
         fclose(fopen(filepath, "w"));
         database_init(&db);
@@ -925,8 +2495,11 @@ int main(int argc, char **argv)
 
         fclose(f);
     }
+    unlock_file(lock);
 
-    if (interactive)
+    if (reminding)
+        remind_mode(&db, filepath, lead, hook);
+    else if (interactive)
         interactive_mode(&db, &filepath);
 
     free(filepath);
@@ -0,0 +1,123 @@
+#include "trie.h"
+
+#include "common.h"
+
+void trie_init(Trie *t)
+{
+    t->root = (TrieNode){0};
+}
+
+static void free_nodes(TrieNode *n)
+{
+    while (n) {
+        TrieNode *next = n->sibling;
+        free_nodes(n->child);
+        free(n);
+        n = next;
+    }
+}
+
+void trie_destroy(Trie *t)
+{
+    free_nodes(t->root.child);
+    trie_init(t);
+}
+
+/* Returns child of n labeled c, or NULL. If link is provided it is set
+ * to the link where such a child is or would be inserted. */
+static TrieNode *find_child(const TrieNode *n, char c, TrieNode ***link)
+{
+    TrieNode **l = (TrieNode **)&n->child;
+    for (; *l && (*l)->c < c; l = &(*l)->sibling);
+    if (link)
+        *link = l;
+    return *l && (*l)->c == c ? *l : NULL;
+}
+
+static const TrieNode *find_node(const Trie *t, const char *word, size_t len)
+{
+    const TrieNode *n = &t->root;
+    for (size_t i = 0; n && i < len; i++)
+        n = find_child(n, word[i], NULL);
+    return n;
+}
+
+bool trie_contains(const Trie *t, const char *word)
+{
+    const TrieNode *n = find_node(t, word, strlen(word));
+    return n && n->refs > 0;
+}
+
+void trie_insert(Trie *t, const char *word)
+{
+    if (!word || !*word)
+        return;
+
+    bool is_new = !trie_contains(t, word);
+    TrieNode *n = &t->root;
+    n->words += is_new;
+    for (; *word; word++) {
+        TrieNode **link;
+        TrieNode *child = find_child(n, *word, &link);
+        if (!child) {
+            child = calloc(1, sizeof(*child));
+            if (!child)
+                FATAL("Failed to allocate trie node!");
+            child->c = *word;
+            child->sibling = *link;
+            *link = child;
+        }
+        n = child;
+        n->words += is_new;
+    }
+    n->refs++;
+}
+
+void trie_remove(Trie *t, const char *word)
+{
+    if (!word || !*word || !trie_contains(t, word))
+        return;
+
+    TrieNode *n = &t->root;
+    const TrieNode *end = find_node(t, word, strlen(word));
+    bool last = end->refs == 1;
+    n->words -= last;
+    for (; *word; word++) {
+        TrieNode **link;
+        TrieNode *child = find_child(n, *word, &link);
+        child->words -= last;
+        if (!child->words) {
+            //nothing else passes through here, drop the whole branch
+            *link = child->sibling;
+            child->sibling = NULL;
+            free_nodes(child);
+            return;
+        }
+        n = child;
+    }
+    n->refs--;
+}
+
+/* Writes to ext the characters shared by every word beginning with
+ * the first len characters of prefix, following the prefix. Returns
+ * the number of distinct words with that prefix. */
+size_t trie_complete(const Trie *t, const char *prefix, size_t len,
+                     char *ext, size_t ext_size)
+{
+    size_t i = 0;
+    const TrieNode *n = find_node(t, prefix, len);
+    if (!n || !n->words) {
+        if (ext_size)
+            ext[0] = '\0';
+        return 0;
+    }
+
+    size_t count = n->words;
+    for (; !n->refs && n->child && !n->child->sibling && i + 1 < ext_size; i++) {
+        n = n->child;
+        ext[i] = n->c;
+    }
+    if (ext_size)
+        ext[i] = '\0';
+    return count;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Prefix tree of reference counted words. Children are kept in a
+ * sorted sibling list. */
+typedef struct TrieNode {
+    char c;
+    unsigned words; //distinct words in this subtree
+    unsigned refs;  //times the word ending here was inserted
+    struct TrieNode *child;
+    struct TrieNode *sibling;
+} TrieNode;
+
+typedef struct Trie {
+    TrieNode root;
+} Trie;
+
+void   trie_init(Trie *t);
+void   trie_destroy(Trie *t);
+void   trie_insert(Trie *t, const char *word);
+void   trie_remove(Trie *t, const char *word);
+bool   trie_contains(const Trie *t, const char *word);
+size_t trie_complete(const Trie *t, const char *prefix, size_t len,
+                     char *ext, size_t ext_size);
@@ -0,0 +1,104 @@
+#define _DEFAULT_SOURCE
+
+#include "watch.h"
+
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "common.h"
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+static void record(FileWatch *w)
+{
+    if (stat(w->path, &w->last) == -1)
+        memset(&w->last, 0, sizeof(w->last));
+}
+
+static bool same_file(struct stat a, struct stat b)
+{
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+        a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+int watch_init(FileWatch *w, const char *filepath)
+{
+    const char *slash = strrchr(filepath, '/');
+    char *dir = slash ? strndup(filepath, slash - filepath + 1) : str_dup(".");
+    w->path = str_dup(filepath);
+    w->name = str_dup(slash ? slash + 1 : filepath);
+    w->wd = -1;
+    record(w);
+
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd != -1)
+        w->wd = inotify_add_watch(w->fd, dir, WATCH_MASK);
+    free(dir);
+
+    if (w->wd == -1) {
+        watch_destroy(w);
+        return -1;
+    }
+    return 0;
+}
+
+void watch_destroy(FileWatch *w)
+{
+    if (w->fd != -1)
+        close(w->fd);
+    w->fd = -1;
+    w->wd = -1;
+    free(w->path);
+    w->path = NULL;
+    free(w->name);
+    w->name = NULL;
+}
+
+/* Records the file as it is after being loaded or saved by us, moving
+ * the watch if the file is a different one */
+void watch_sync(FileWatch *w, const char *filepath)
+{
+    if (w->fd == -1)
+        return;
+    if (strcmp(w->path, filepath)) {
+        watch_destroy(w);
+        watch_init(w, filepath);
+    } else {
+        record(w);
+    }
+}
+
+/* As watch_sync, given the file as it was when written, for when it may
+ * have been replaced since */
+void watch_sync_stat(FileWatch *w, const char *filepath, const struct stat *st)
+{
+    watch_sync(w, filepath);
+    if (w->fd != -1)
+        w->last = *st;
+}
+
+/* Consumes pending events, returning whether the file was changed by
+ * someone else since it was last recorded */
+bool watch_changed(FileWatch *w)
+{
+    if (w->fd == -1)
+        return false;
+
+    bool touched = false;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len && !strcmp(ev->name, w->name))
+                touched = true;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+
+    struct stat prev = w->last;
+    if (!touched)
+        return false;
+    record(w);
+    return !same_file(prev, w->last);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/* Watches a file for being rewritten or replaced by another process.
+ * The directory is watched, as saving replaces the file. */
+typedef struct FileWatch {
+    int fd; //-1 when not watching
+    int wd;
+    char *path;
+    char *name;
+    struct stat last; //file as last loaded or saved by us
+} FileWatch;
+
+int  watch_init(FileWatch *w, const char *filepath);
+void watch_destroy(FileWatch *w);
+void watch_sync(FileWatch *w, const char *filepath);
+void watch_sync_stat(FileWatch *w, const char *filepath, const struct stat *st);
+bool watch_changed(FileWatch *w);
@@ -0,0 +1,93 @@
+#include "wheel.h"
+
+#include "common.h"
+
+#define WHEEL_SPAN ((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+void wheel_init(TimerWheel *w, int64_t now)
+{
+    w->now = now;
+    memset(w->slots, 0, sizeof(w->slots));
+    w->count = 0;
+}
+
+void wheel_destroy(TimerWheel *w)
+{
+    for (unsigned level = 0; level < WHEEL_LEVELS; level++) {
+        for (unsigned i = 0; i < WHEEL_SLOTS; i++) {
+            for (Timer *t = w->slots[level][i], *next; t; t = next) {
+                next = t->next;
+                free(t);
+            }
+        }
+    }
+    wheel_init(w, w->now);
+}
+
+/* Links t into the slot of the lowest level whose span reaches its due
+ * tick from now */
+static void place(TimerWheel *w, Timer *t)
+{
+    int64_t delta = t->due - w->now;
+    unsigned level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (int64_t)1 << (WHEEL_BITS * (level + 1)))
+        level++;
+    unsigned i = (t->due >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    t->next = w->slots[level][i];
+    w->slots[level][i] = t;
+}
+
+/* Adds a timer due after now and within the span of the wheel. Returns
+ * -1 if it is not. */
+int wheel_add(TimerWheel *w, int64_t due, int64_t start, uint64_t id)
+{
+    if (due <= w->now || due - w->now >= WHEEL_SPAN)
+        return -1;
+
+    Timer *t = malloc(sizeof(*t));
+    if (!t)
+        FATAL("Failed to allocate timer!");
+    *t = (Timer){due, start, id, NULL};
+    place(w, t);
+    w->count++;
+    return 0;
+}
+
+/* Spreads the timers of the current slot of level over the levels
+ * below, once the levels below have wrapped around */
+static void cascade(TimerWheel *w, unsigned level)
+{
+    unsigned i = (w->now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    if (!i && level < WHEEL_LEVELS - 1)
+        cascade(w, level + 1);
+
+    Timer *t = w->slots[level][i];
+    w->slots[level][i] = NULL;
+    while (t) {
+        Timer *next = t->next;
+        place(w, t);
+        t = next;
+    }
+}
+
+/* Moves the wheel on one tick at a time up to now, calling fn on each
+ * timer as it comes due */
+void wheel_advance(TimerWheel *w, int64_t now, timer_fn fn, void *data)
+{
+    while (w->now < now) {
+        w->now++;
+        unsigned i = w->now & (WHEEL_SLOTS - 1);
+        if (!i)
+            cascade(w, 1);
+
+        Timer *t = w->slots[0][i];
+        w->slots[0][i] = NULL;
+        while (t) {
+            Timer *next = t->next;
+            fn(t, data);
+            free(t);
+            w->count--;
+            t = next;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4 //spanning 2^24 ticks, about 32 years of minutes
+
+/* Reminder of an event, due some ticks before the event starts */
+typedef struct Timer {
+    int64_t due;
+    int64_t start; //of the event or occurrence reminded of
+    uint64_t id;
+    struct Timer *next;
+} Timer;
+
+/* Hierarchical timing wheel. Level k holds the timers due within
+ * 64^(k + 1) ticks in slots of 64^k ticks, and each time the level below
+ * wraps around, the next slot of a level is spread over the ones below,
+ * so adding and firing a timer take constant time. */
+typedef struct TimerWheel {
+    int64_t now; //last tick advanced to
+    Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    size_t count;
+} TimerWheel;
+
+typedef void (*timer_fn)(const Timer *t, void *data);
+
+void wheel_init(TimerWheel *w, int64_t now);
+void wheel_destroy(TimerWheel *w);
+int  wheel_add(TimerWheel *w, int64_t due, int64_t start, uint64_t id);
+void wheel_advance(TimerWheel *w, int64_t now, timer_fn fn, void *data);